@@ -0,0 +1,241 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#include "allocation_tracker.h"
+
+constexpr int maxAllocationScopes = 64;
+
+// Everything here is constant initialized, so it is usable by allocations made before main
+struct ScopeCounters
+{
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> liveBytes;
+    std::atomic<uint64_t> peakBytes;
+};
+
+static const char* scopeNames[maxAllocationScopes] = { "Unscoped" };
+static ScopeCounters scopeCounters[maxAllocationScopes];
+static std::atomic<int> scopeCount = 1;
+static std::mutex registerMutex;
+static thread_local int currentScope = 0;
+
+// Scope names are few and registered once, lookups after that only read
+static int RegisterScope(const char* name)
+{
+    int count = scopeCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(scopeNames[i], name) == 0)
+            return i;
+    }
+
+    std::lock_guard<std::mutex> lock(registerMutex);
+    count = scopeCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(scopeNames[i], name) == 0)
+            return i;
+    }
+
+    if (count == maxAllocationScopes)
+        return 0;
+
+    scopeNames[count] = name;
+    scopeCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+AllocationScope::AllocationScope(const char* name)
+    : previousScope(currentScope)
+{
+    if (isAllocationTrackingEnabled)
+        currentScope = RegisterScope(name);
+}
+
+AllocationScope::~AllocationScope()
+{
+    currentScope = previousScope;
+}
+
+std::vector<AllocationScopeStats> GetAllocationScopeStats()
+{
+    std::vector<AllocationScopeStats> stats;
+    int count = scopeCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        const ScopeCounters& counters = scopeCounters[i];
+        stats.push_back({ scopeNames[i], counters.count.load(std::memory_order_relaxed), counters.bytes.load(std::memory_order_relaxed),
+            counters.liveBytes.load(std::memory_order_relaxed), counters.peakBytes.load(std::memory_order_relaxed) });
+    }
+
+    return stats;
+}
+
+uint64_t GetAllocationCount()
+{
+    uint64_t count = 0;
+    for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++)
+        count += scopeCounters[i].count.load(std::memory_order_relaxed);
+    return count;
+}
+
+uint64_t GetAllocatedBytes()
+{
+    uint64_t bytes = 0;
+    for (int i = 0; i < scopeCount.load(std::memory_order_acquire); i++)
+        bytes += scopeCounters[i].bytes.load(std::memory_order_relaxed);
+    return bytes;
+}
+
+void PrintAllocationReport()
+{
+    if (!isAllocationTrackingEnabled)
+        return;
+
+    printf("%-20s %12s %14s %14s %14s\n", "Scope", "Allocations", "Bytes", "Peak bytes", "Live bytes");
+    for (const AllocationScopeStats& stats : GetAllocationScopeStats())
+    {
+        printf("%-20s %12llu %14llu %14llu %14llu\n", stats.name, (unsigned long long)stats.count, (unsigned long long)stats.bytes,
+            (unsigned long long)stats.peakBytes, (unsigned long long)stats.liveBytes);
+    }
+}
+
+static void AddAllocation(int scope, uint64_t size)
+{
+    ScopeCounters& counters = scopeCounters[scope];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    uint64_t liveBytes = counters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+    while (peakBytes < liveBytes && !counters.peakBytes.compare_exchange_weak(peakBytes, liveBytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+int AddExternalAllocation(size_t size)
+{
+    if (!isAllocationTrackingEnabled)
+        return 0;
+
+    AddAllocation(currentScope, size);
+    return currentScope;
+}
+
+void RemoveExternalAllocation(int scope, size_t size)
+{
+    if (isAllocationTrackingEnabled)
+        scopeCounters[scope].liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+// Each block is preceded by its scope and size, 16 bytes keep the default new alignment
+struct AllocationHeader
+{
+    uint32_t scope;
+    uint32_t padding;
+    uint64_t size;
+};
+
+static_assert(sizeof(AllocationHeader) == __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+void* TrackedMalloc(size_t size)
+{
+    AllocationHeader* header = static_cast<AllocationHeader*>(malloc(sizeof(AllocationHeader) + size));
+    if (!header)
+        return nullptr;
+
+    header->scope = currentScope;
+    header->size = size;
+    AddAllocation(header->scope, size);
+    return header + 1;
+}
+
+// A resized block stays with the scope that first allocated it and counts as a new allocation of the new size
+void* TrackedRealloc(void* ptr, size_t size)
+{
+    if (!ptr)
+        return TrackedMalloc(size);
+
+    AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+    uint32_t scope = header->scope;
+    uint64_t oldSize = header->size;
+    header = static_cast<AllocationHeader*>(realloc(header, sizeof(AllocationHeader) + size));
+    if (!header)
+        return nullptr;
+
+    header->size = size;
+    scopeCounters[scope].liveBytes.fetch_sub(oldSize, std::memory_order_relaxed);
+    AddAllocation(scope, size);
+    return header + 1;
+}
+
+void TrackedFree(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+    scopeCounters[header->scope].liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+    free(header);
+}
+
+void* operator new(size_t size)
+{
+    void* ptr = TrackedMalloc(size);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return TrackedMalloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return TrackedMalloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    TrackedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    TrackedFree(ptr);
+}
+
+#endif
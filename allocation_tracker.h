@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Global operator new/delete are only replaced in builds with TRACK_ALLOCATIONS (make allocations),
+// other builds keep the default allocator and report no allocations
+#ifdef TRACK_ALLOCATIONS
+constexpr bool isAllocationTrackingEnabled = true;
+
+// rapidjson allocates its DOM pools with malloc. The allocations build includes this header
+// ahead of every file, so these take over before rapidjson picks its defaults
+void* TrackedMalloc(size_t size);
+void* TrackedRealloc(void* ptr, size_t size);
+void TrackedFree(void* ptr);
+
+#define RAPIDJSON_MALLOC(size) TrackedMalloc(size)
+#define RAPIDJSON_REALLOC(ptr, newSize) TrackedRealloc(ptr, newSize)
+#define RAPIDJSON_FREE(ptr) TrackedFree(ptr)
+#else
+constexpr bool isAllocationTrackingEnabled = false;
+#endif
+
+struct AllocationScopeStats
+{
+    const char* name;
+    uint64_t count;
+    uint64_t bytes;
+    uint64_t liveBytes;
+    uint64_t peakBytes;
+};
+
+// Attributes allocations of the current thread to a named scope while it lives. Scopes nest and the
+// innermost one is charged. Frees are returned to the scope that made the allocation, wherever they happen
+class AllocationScope
+{
+public:
+    explicit AllocationScope(const char* name);
+    ~AllocationScope();
+
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    int previousScope;
+};
+
+// Allocations made outside any scope are listed as "Unscoped"
+std::vector<AllocationScopeStats> GetAllocationScopeStats();
+
+// Running totals over all scopes, differences between frames give allocations per frame
+uint64_t GetAllocationCount();
+uint64_t GetAllocatedBytes();
+
+void PrintAllocationReport();
+
+// Counts memory taken around operator new, like mesh arrays mapped on huge pages, in the current scope.
+// The returned scope is handed back when the memory is released. Both do nothing outside the allocations build
+int AddExternalAllocation(size_t size);
+void RemoveExternalAllocation(int scope, size_t size);
@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/prettywriter.h"
+
+#include "batch.h"
+#include "block_reader.h"
+#include "bounded_queue.h"
+#include "gltf.h"
+#include "mesh.h"
+#include "mesh_binary.h"
+#include "metrics.h"
+#include "perf_counters.h"
+
+struct BatchJob
+{
+    std::filesystem::path path;
+    size_t bytes = 0;
+    std::unique_ptr<Mesh> mesh;
+    TriangleStatistics stats;
+    double readMs = 0;
+    double parseMs = 0;
+    double normalsMs = 0;
+    double writeMs = 0;
+    bool isValid = false;
+};
+
+using BatchQueue = BoundedQueue<std::unique_ptr<BatchJob>>;
+
+static MetricsGauge pathQueueDepth("viewer_batch_queue_depth", "queue=\"path\"", "Jobs waiting in front of each batch stage.");
+static MetricsGauge readQueueDepth("viewer_batch_queue_depth", "queue=\"read\"", "");
+static MetricsGauge parsedQueueDepth("viewer_batch_queue_depth", "queue=\"parsed\"", "");
+static MetricsGauge normalsQueueDepth("viewer_batch_queue_depth", "queue=\"normals\"", "");
+static LatencyHistogram jobTimes("viewer_batch_job_seconds", "", "Processing time of a batch job summed over its stages.");
+
+// Hardware counters of one stage, summed per thread when perfCounterSettings is enabled
+struct BatchStage
+{
+    BatchStage(const char* name) : name(name) {}
+
+    const char* name;
+    std::vector<PerfCounterValues> threadCounters;
+    double totalMs = 0;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Runs a stage on several threads, the last thread to finish closes the output queue
+template<typename Function>
+static void StartStage(std::vector<std::thread>& threads, int threadCount, BatchStage& stage, BatchQueue& input, BatchQueue& output,
+    Function function)
+{
+    stage.threadCounters.resize(threadCount);
+    auto remainingCount = std::make_shared<std::atomic<int>>(threadCount);
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back(
+            [&input, &output, &threadCounters = stage.threadCounters[i], function, remainingCount]
+            {
+                // Counters only see the calling thread, so each stage thread opens its own
+                PerfCounters counters;
+                std::unique_ptr<BatchJob> job;
+                while (input.Pop(job))
+                {
+                    counters.Start();
+                    function(*job);
+                    threadCounters += counters.Stop();
+                    output.Push(std::move(job));
+                }
+
+                if (--*remainingCount == 0)
+                    output.Close();
+            });
+    }
+}
+
+// Queues the whole file for reading into the page cache without copying it, so the disk works
+// on the files waiting in the read queue while the parse threads work on earlier ones
+static void ReadFile(BatchJob& job)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::error_code error;
+    job.bytes = std::filesystem::file_size(job.path, error);
+    if (!error)
+        PrefetchFile(job.path.c_str());
+
+    job.readMs = MillisecondsSince(startTime);
+}
+
+static void WriteCounters(rapidjson::PrettyWriter<rapidjson::FileWriteStream>& writer, const PerfCounterValues& counters,
+    size_t triangleCount)
+{
+    writer.StartObject();
+    for (int i = 0; i < perfCounterCount; i++)
+    {
+        if (counters.isAvailable[i])
+        {
+            writer.Key(perfCounterNames[i]);
+            writer.Uint64(counters.values[i]);
+        }
+    }
+
+    if (counters.isAvailable[perfCycles] && counters.isAvailable[perfInstructions])
+    {
+        writer.Key("instructionsPerCycle");
+        writer.Double(counters.GetInstructionsPerCycle());
+    }
+
+    // Every last level cache miss brings in a 64 byte line, a lower bound on the memory traffic per triangle
+    if (counters.isAvailable[perfCacheMisses] && triangleCount > 0)
+    {
+        writer.Key("missBytesPerTriangle");
+        writer.Double(counters.values[perfCacheMisses] * 64.0 / triangleCount);
+    }
+
+    if (counters.isAvailable[perfCycles] && triangleCount > 0)
+    {
+        writer.Key("cyclesPerTriangle");
+        writer.Double(double(counters.values[perfCycles]) / triangleCount);
+    }
+    writer.EndObject();
+}
+
+static void WriteReport(const std::vector<std::unique_ptr<BatchJob>>& jobs, const std::filesystem::path& path, double totalSeconds,
+    std::vector<BatchStage>& stages)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write report" << std::endl;
+        return;
+    }
+
+    char buffer[65536];
+    rapidjson::FileWriteStream outputStream(file, buffer, sizeof(buffer));
+    rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(outputStream);
+
+    size_t totalBytes = 0;
+    size_t triangleCount = 0;
+    int failedCount = 0;
+
+    writer.StartObject();
+    writer.Key("files");
+    writer.StartArray();
+    for (const auto& job : jobs)
+    {
+        totalBytes += job->bytes;
+        failedCount += job->isValid ? 0 : 1;
+        triangleCount += job->isValid ? job->mesh->indexCount / 3 : 0;
+        stages[0].totalMs += job->readMs;
+        stages[1].totalMs += job->parseMs;
+        stages[2].totalMs += job->normalsMs;
+        stages[3].totalMs += job->writeMs;
+
+        writer.StartObject();
+        writer.Key("file");
+        writer.String(job->path.filename().c_str());
+        writer.Key("bytes");
+        writer.Uint64(job->bytes);
+        writer.Key("ok");
+        writer.Bool(job->isValid);
+        if (job->isValid)
+        {
+            writer.Key("vertices");
+            writer.Uint64(job->mesh->vertexCount);
+            writer.Key("triangles");
+            writer.Uint64(job->mesh->indexCount / 3);
+            writer.Key("minArea");
+            writer.Double(job->stats.minArea);
+            writer.Key("maxArea");
+            writer.Double(job->stats.maxArea);
+            writer.Key("avgArea");
+            writer.Double(job->stats.avgArea);
+        }
+        writer.Key("readMs");
+        writer.Double(job->readMs);
+        writer.Key("parseMs");
+        writer.Double(job->parseMs);
+        writer.Key("normalsMs");
+        writer.Double(job->normalsMs);
+        writer.Key("writeMs");
+        writer.Double(job->writeMs);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("summary");
+    writer.StartObject();
+    writer.Key("fileCount");
+    writer.Uint64(jobs.size());
+    writer.Key("failedCount");
+    writer.Int(failedCount);
+    writer.Key("totalBytes");
+    writer.Uint64(totalBytes);
+    writer.Key("seconds");
+    writer.Double(totalSeconds);
+    writer.Key("filesPerSecond");
+    writer.Double(jobs.size() / totalSeconds);
+    writer.Key("megabytesPerSecond");
+    writer.Double(totalBytes / (1024.0 * 1024.0) / totalSeconds);
+    writer.Key("triangleCount");
+    writer.Uint64(triangleCount);
+
+    writer.Key("stages");
+    writer.StartArray();
+    for (const BatchStage& stage : stages)
+    {
+        PerfCounterValues counters;
+        for (const PerfCounterValues& threadCounters : stage.threadCounters)
+            counters += threadCounters;
+
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(stage.name);
+        writer.Key("threads");
+        writer.Uint64(stage.threadCounters.size());
+        writer.Key("ms");
+        writer.Double(stage.totalMs);
+        writer.Key("trianglesPerSecond");
+        writer.Double(stage.totalMs > 0 ? triangleCount / (stage.totalMs / 1000) : 0);
+        if (counters.IsAnyAvailable())
+        {
+            writer.Key("counters");
+            WriteCounters(writer, counters, triangleCount);
+            writer.Key("threadCounters");
+            writer.StartArray();
+            for (const PerfCounterValues& threadCounters : stage.threadCounters)
+                WriteCounters(writer, threadCounters, triangleCount);
+            writer.EndArray();
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndObject();
+
+    outputStream.Flush();
+    fclose(file);
+}
+
+int RunBatch(const char* inputDir, const char* outputDir, const char* format)
+{
+    std::string extension = std::string(".") + format;
+    if (extension != ".mbin" && extension != ".glb")
+    {
+        std::cerr << "Unsupported output format " << format << std::endl;
+        return 1;
+    }
+
+    std::error_code error;
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(inputDir, error))
+    {
+        const auto fileExtension = entry.path().extension();
+        if (entry.is_regular_file() && (fileExtension == ".json" || fileExtension == ".gz" || fileExtension == ".zst" || fileExtension == ".glb" || fileExtension == ".obj"))
+            paths.push_back(entry.path());
+    }
+
+    if (error)
+    {
+        std::cerr << "Failed to read directory " << inputDir << std::endl;
+        return 1;
+    }
+
+    std::sort(paths.begin(), paths.end());
+    std::filesystem::create_directories(outputDir, error);
+
+    // Reading and writing are disk bound and get one thread each, parsing and normals share the cores
+    int coreCount = std::max(2u, std::thread::hardware_concurrency());
+    int parseThreadCount = std::max(1, coreCount * 2 / 3);
+    int normalsThreadCount = std::max(1, coreCount - parseThreadCount);
+
+    // Parsed meshes are the large items, so the queues after parsing stay short
+    BatchQueue pathQueue(paths.size() + 1, &pathQueueDepth);
+    BatchQueue readQueue(parseThreadCount * 2, &readQueueDepth);
+    BatchQueue parsedQueue(normalsThreadCount + 1, &parsedQueueDepth);
+    BatchQueue normalsQueue(2, &normalsQueueDepth);
+    BatchQueue doneQueue(paths.size() + 1);
+
+    auto startTime = std::chrono::steady_clock::now();
+    for (const auto& path : paths)
+    {
+        auto job = std::make_unique<BatchJob>();
+        job->path = path;
+        pathQueue.Push(std::move(job));
+    }
+    pathQueue.Close();
+
+    std::vector<BatchStage> stages = { { "read" }, { "parse" }, { "normals" }, { "write" } };
+    std::vector<std::thread> threads;
+    StartStage(threads, 1, stages[0], pathQueue, readQueue, ReadFile);
+    StartStage(threads, parseThreadCount, stages[1], readQueue, parsedQueue,
+        [](BatchJob& job)
+        {
+            auto stageStartTime = std::chrono::steady_clock::now();
+            job.mesh = Mesh::TryLoad(job.path.c_str(), nullptr, true);
+            job.isValid = job.mesh != nullptr;
+            job.parseMs = MillisecondsSince(stageStartTime);
+        });
+    StartStage(threads, normalsThreadCount, stages[2], parsedQueue, normalsQueue,
+        [](BatchJob& job)
+        {
+            if (!job.isValid)
+                return;
+
+            // Loads defer normals and statistics to this stage so each stage times and counts one kind of work
+            auto stageStartTime = std::chrono::steady_clock::now();
+            job.mesh->CalculateDeferredNormals();
+            job.stats = job.mesh->CalculateStatistics();
+            job.normalsMs = MillisecondsSince(stageStartTime);
+        });
+    StartStage(threads, 1, stages[3], normalsQueue, doneQueue,
+        [&outputDir, &extension](BatchJob& job)
+        {
+            if (!job.isValid)
+                return;
+
+            auto stageStartTime = std::chrono::steady_clock::now();
+            // Keep the source extension so lucy.json and lucy.glb do not overwrite each other
+            std::filesystem::path outputPath = std::filesystem::path(outputDir) / job.path.filename();
+            outputPath += extension;
+            job.isValid = extension == ".glb" ? WriteGlb(*job.mesh, outputPath.c_str()) : WriteBinaryMesh(*job.mesh, outputPath.c_str());
+            job.writeMs = MillisecondsSince(stageStartTime);
+
+            // Keep only metadata for the report
+            job.mesh->ReleaseCpuData();
+        });
+
+    std::vector<std::unique_ptr<BatchJob>> jobs;
+    std::unique_ptr<BatchJob> job;
+    while (doneQueue.Pop(job))
+    {
+        jobTimes.Record((job->readMs + job->parseMs + job->normalsMs + job->writeMs) / 1000);
+        jobs.push_back(std::move(job));
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    double totalSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    std::sort(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) { return a->path < b->path; });
+
+    std::filesystem::path reportPath = std::filesystem::path(outputDir) / "report.json";
+    WriteReport(jobs, reportPath, totalSeconds, stages);
+
+    bool hasCounters = std::any_of(stages.begin(), stages.end(),
+        [](const BatchStage& stage)
+        { return std::any_of(stage.threadCounters.begin(), stage.threadCounters.end(), [](const auto& counters) { return counters.IsAnyAvailable(); }); });
+    if (perfCounterSettings.isEnabled && !hasCounters)
+        std::cerr << "Hardware counters are not available here (perf_event_paranoid or container limits), the report only has times" << std::endl;
+
+    size_t failedCount = std::count_if(jobs.begin(), jobs.end(), [](const auto& job) { return !job->isValid; });
+    std::cout << jobs.size() << " files in " << totalSeconds << " s (" << jobs.size() / totalSeconds << " files/s), " << failedCount
+              << " failed, report written to " << reportPath.string() << std::endl;
+    return failedCount == 0 ? 0 : 1;
+}
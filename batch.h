@@ -0,0 +1,7 @@
+#pragma once
+
+// Streams every mesh file in the input directory through concurrent read, parse,
+// normals and statistics, and write stages connected by bounded queues. Meshes are written to the
+// output directory as .mbin or .glb, with per-file timings and a throughput summary
+// in report.json next to them
+int RunBatch(const char* inputDir, const char* outputDir, const char* format);
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#include "block_reader.h"
+
+BlockReaderSettings blockReaderSettings;
+
+// Blocks are page aligned so reads can go straight from the page cache or disk into them
+constexpr size_t blockAlignment = 4096;
+
+#ifdef __linux__
+// Submission and completion rings shared with the kernel, set up with the raw syscalls
+struct IoUring
+{
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    std::unique_ptr<iovec[]> iovecs;
+
+    ~IoUring()
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+    }
+};
+
+// Returns null when the kernel has no io_uring or it is disabled for this process
+static std::unique_ptr<IoUring> CreateIoUring(unsigned entries)
+{
+    io_uring_params params = {};
+    int ringFd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ringFd < 0)
+        return nullptr;
+
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->fd = ringFd;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool isSingleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (isSingleMapping)
+        ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+
+    ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+        return nullptr;
+
+    ring->cqRing = isSingleMapping ? ring->sqRing : mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED)
+        return nullptr;
+
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+    if (ring->sqes == MAP_FAILED)
+        return nullptr;
+
+    char* sq = static_cast<char*>(ring->sqRing);
+    char* cq = static_cast<char*>(ring->cqRing);
+    ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    ring->iovecs.reset(new iovec[entries]);
+    return ring;
+}
+#else
+struct IoUring
+{
+};
+
+static std::unique_ptr<IoUring> CreateIoUring(unsigned)
+{
+    return nullptr;
+}
+#endif
+
+// Issues a non-blocking read-ahead request for the given range
+static void AdviseWillNeed(int fd, off_t offset, size_t size)
+{
+#ifdef __APPLE__
+    radvisory advisory = { offset, int(size) };
+    fcntl(fd, F_RDADVISE, &advisory);
+#else
+    posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED);
+#endif
+}
+
+bool PrefetchFile(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+#ifdef __APPLE__
+    struct stat fileStat;
+    bool didAdvise = fstat(fd, &fileStat) == 0;
+    if (didAdvise)
+    {
+        radvisory advisory = { 0, int(std::min<off_t>(fileStat.st_size, INT_MAX)) };
+        didAdvise = fcntl(fd, F_RDADVISE, &advisory) != -1;
+    }
+#else
+    bool didAdvise = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+#endif
+
+    close(fd);
+    return didAdvise;
+}
+
+BlockReader::BlockReader(const char* path)
+    : fd(open(path, O_RDONLY)), fileSize(0), blockSize(blockReaderSettings.blockSize), queueDepth(std::max<size_t>(blockReaderSettings.queueDepth, 1)),
+      readOffset(0), advisedEnd(0), didFail(false), blockData(nullptr)
+{
+    if (fd < 0)
+        return;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        close(fd);
+        fd = -1;
+        return;
+    }
+
+    fileSize = fileStat.st_size;
+    blockSize = (std::max(blockSize, blockAlignment) + blockAlignment - 1) & ~(blockAlignment - 1);
+
+#ifndef __APPLE__
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (!blockReaderSettings.useIoUring || fileSize == 0)
+        return;
+
+    ring = CreateIoUring(unsigned(queueDepth));
+    blockData = ring ? static_cast<char*>(std::aligned_alloc(blockAlignment, blockSize * queueDepth)) : nullptr;
+    if (!blockData)
+    {
+        ring.reset();
+        return;
+    }
+
+    // Queue the first blocks, each slot then moves queueDepth blocks ahead once it has been copied out
+    blocks.reset(new Block[queueDepth]);
+    for (size_t i = 0; i < queueDepth && i * blockSize < fileSize; i++)
+    {
+        blocks[i].offset = off_t(i * blockSize);
+        blocks[i].size = std::min(blockSize, fileSize - i * blockSize);
+        if (!SubmitBlock(i))
+        {
+            // Nothing is in flight when the first submission fails, so pread can still take over
+            if (i == 0)
+            {
+                ring.reset();
+                std::free(blockData);
+                blockData = nullptr;
+            }
+            else
+                didFail = true;
+            break;
+        }
+    }
+}
+
+BlockReader::~BlockReader()
+{
+    if (ring)
+    {
+        // The kernel may still write into the blocks, so every read has to complete before they are freed
+        bool isPending = true;
+        while (isPending)
+        {
+            isPending = false;
+            for (size_t i = 0; i < queueDepth; i++)
+                isPending = isPending || blocks[i].isPending;
+
+            if (isPending && !WaitForCompletions())
+            {
+                // Leaking the blocks is the only safe option when completions cannot be reaped
+                blockData = nullptr;
+                break;
+            }
+        }
+    }
+
+    ring.reset();
+    std::free(blockData);
+
+    if (fd >= 0)
+        close(fd);
+}
+
+size_t BlockReader::Read(char* buffer, size_t capacity)
+{
+    if (fd < 0 || didFail)
+        return 0;
+
+    return ring ? ReadFromRing(buffer, capacity) : ReadWithPread(buffer, capacity);
+}
+
+size_t BlockReader::ReadWithPread(char* buffer, size_t capacity)
+{
+    // Keep the window after the range being read queued with the kernel
+    off_t windowStart = std::max(advisedEnd, readOffset + off_t(capacity));
+    off_t windowEnd = readOffset + off_t(capacity + blockSize * queueDepth);
+    if (windowEnd > windowStart)
+    {
+        AdviseWillNeed(fd, windowStart, windowEnd - windowStart);
+        advisedEnd = windowEnd;
+    }
+
+    size_t size = 0;
+    while (size < capacity)
+    {
+        ssize_t readCount = pread(fd, buffer + size, capacity - size, readOffset + size);
+        if (readCount < 0 && errno == EINTR)
+            continue;
+        if (readCount < 0)
+            didFail = true;
+        if (readCount <= 0)
+            break;
+        size += readCount;
+    }
+
+    readOffset += size;
+    return didFail ? 0 : size;
+}
+
+size_t BlockReader::ReadFromRing(char* buffer, size_t capacity)
+{
+    size_t size = 0;
+    while (size < capacity && size_t(readOffset) < fileSize)
+    {
+        size_t slot = (size_t(readOffset) / blockSize) % queueDepth;
+        Block& block = blocks[slot];
+        while (block.isPending && !didFail)
+            didFail = !WaitForCompletions();
+
+        // A short block at the end means the file shrank after it was opened, fileSize was lowered to match
+        if (didFail || size_t(readOffset) >= fileSize)
+            break;
+
+        size_t blockOffset = size_t(readOffset - block.offset);
+        size_t count = std::min(block.filled - blockOffset, capacity - size);
+        memcpy(buffer + size, blockData + slot * blockSize + blockOffset, count);
+        size += count;
+        readOffset += off_t(count);
+
+        if (size_t(readOffset - block.offset) == block.filled)
+        {
+            block.offset += off_t(blockSize * queueDepth);
+            block.filled = 0;
+            if (size_t(block.offset) < fileSize)
+            {
+                block.size = std::min(blockSize, fileSize - size_t(block.offset));
+                didFail = !SubmitBlock(slot);
+            }
+        }
+    }
+
+    return didFail ? 0 : size;
+}
+
+bool BlockReader::SubmitBlock(size_t slot)
+{
+#ifdef __linux__
+    Block& block = blocks[slot];
+    iovec& vector = ring->iovecs[slot];
+    vector.iov_base = blockData + slot * blockSize + block.filled;
+    vector.iov_len = block.size - block.filled;
+
+    // Only this thread submits, so the tail is read plainly and published with a release store
+    unsigned tail = *ring->sqTail;
+    unsigned idx = tail & *ring->sqMask;
+    io_uring_sqe& sqe = ring->sqes[idx];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = fd;
+    sqe.off = block.offset + block.filled;
+    sqe.addr = reinterpret_cast<uintptr_t>(&vector);
+    sqe.len = 1;
+    sqe.user_data = slot;
+    ring->sqArray[idx] = idx;
+    std::atomic_ref<unsigned>(*ring->sqTail).store(tail + 1, std::memory_order_release);
+
+    int submitted;
+    do
+        submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, nullptr, 0);
+    while (submitted < 0 && errno == EINTR);
+
+    block.isPending = submitted == 1;
+    return block.isPending;
+#else
+    (void)slot;
+    return false;
+#endif
+}
+
+bool BlockReader::WaitForCompletions()
+{
+#ifdef __linux__
+    unsigned head = *ring->cqHead;
+    if (head == std::atomic_ref<unsigned>(*ring->cqTail).load(std::memory_order_acquire))
+    {
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+            return false;
+    }
+
+    bool isOk = true;
+    unsigned tail = std::atomic_ref<unsigned>(*ring->cqTail).load(std::memory_order_acquire);
+    for (; head != tail; head++)
+    {
+        const io_uring_cqe& cqe = ring->cqes[head & *ring->cqMask];
+        size_t slot = size_t(cqe.user_data);
+        Block& block = blocks[slot];
+        block.isPending = false;
+
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+            isOk = SubmitBlock(slot) && isOk;
+        else if (cqe.res < 0)
+            isOk = false;
+        else if (cqe.res == 0)
+            fileSize = std::min(fileSize, size_t(block.offset) + block.filled);
+        else
+        {
+            // Short reads are continued from where they stopped
+            block.filled += size_t(cqe.res);
+            if (block.filled < block.size)
+                isOk = SubmitBlock(slot) && isOk;
+        }
+    }
+
+    std::atomic_ref<unsigned>(*ring->cqHead).store(head, std::memory_order_release);
+    return isOk;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+
+struct BlockReaderSettings
+{
+    // Falls back to pread when io_uring is off, unsupported or blocked for the process
+    bool useIoUring = true;
+    size_t blockSize = 1024 * 1024;
+    size_t queueDepth = 8;
+
+    // Plain JSON is parsed from a FileReadStream unless set. The block reader feeding the parser through
+    // another thread measured slower on JSON (--bench-read), OBJ files always use it
+    bool isUsedForJson = false;
+};
+
+extern BlockReaderSettings blockReaderSettings;
+
+// Asks the kernel to start reading the whole file into the page cache and returns without waiting,
+// false when the file cannot be opened or the hint is not supported
+bool PrefetchFile(const char* path);
+
+struct IoUring;
+
+// Reads a file front to back in large aligned blocks with several reads in flight.
+// On Linux the reads are queued on an io_uring, elsewhere or when that is not possible
+// the blocks are read with pread while the kernel is hinted to fetch the ones after them
+class BlockReader
+{
+public:
+    explicit BlockReader(const char* path);
+    ~BlockReader();
+
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Copies the next bytes of the file, fills the whole buffer unless the end is reached.
+    // Returns 0 at the end and after a failed read
+    size_t Read(char* buffer, size_t capacity);
+
+    bool IsValid() const { return fd >= 0; }
+    bool DidFail() const { return didFail; }
+    bool IsUsingIoUring() const { return ring != nullptr; }
+    size_t GetFileSize() const { return fileSize; }
+
+private:
+    struct Block
+    {
+        off_t offset = 0;
+        size_t size = 0;
+        size_t filled = 0;
+        bool isPending = false;
+    };
+
+    int fd;
+    size_t fileSize;
+    size_t blockSize;
+    size_t queueDepth;
+    off_t readOffset;
+    off_t advisedEnd;
+    bool didFail;
+
+    std::unique_ptr<IoUring> ring;
+    char* blockData;
+    std::unique_ptr<Block[]> blocks;
+
+    size_t ReadWithPread(char* buffer, size_t capacity);
+    size_t ReadFromRing(char* buffer, size_t capacity);
+    bool SubmitBlock(size_t blockIdx);
+    bool WaitForCompletions();
+};
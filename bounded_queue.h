@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+#include "metrics.h"
+
+// Blocking queue with a fixed capacity connecting pipeline stages, a full queue
+// holds back the producing stage so memory stays bounded
+template<typename T>
+class BoundedQueue
+{
+public:
+    // The optional gauge follows the number of queued items
+    BoundedQueue(size_t capacity, MetricsGauge* depthGauge = nullptr)
+        : capacity(capacity), isClosed(false), depthGauge(depthGauge)
+    {
+    }
+
+    void Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        UpdateDepth();
+        notEmpty.notify_one();
+    }
+
+    // Returns false once the queue is closed and drained
+    bool Pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return !items.empty() || isClosed; });
+        if (items.empty())
+            return false;
+
+        item = std::move(items.front());
+        items.pop_front();
+        UpdateDepth();
+        notFull.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isClosed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool isClosed;
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    MetricsGauge* depthGauge;
+
+    void UpdateDepth()
+    {
+        if (depthGauge)
+            depthGauge->Set(items.size());
+    }
+};
@@ -0,0 +1,434 @@
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "batch.h"
+#include "block_reader.h"
+#include "cli.h"
+#include "gltf.h"
+#include "headless.h"
+#include "mesh.h"
+#include "mesh_allocator.h"
+#include "mesh_binary.h"
+#include "mesh_cache.h"
+#include "mesh_partition.h"
+#include "mesh_sequence.h"
+#include "obj.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "scaling_check.h"
+#include "out_of_core_mesh.h"
+#include "pipelined_stream.h"
+#include "shared_mesh.h"
+#include "tiled_mesh.h"
+
+static void PrintUsage()
+{
+    std::cerr << "Usage:\n"
+              << "  run                                                Start the viewer\n"
+              << "  run --convert <mesh> <mesh.mbin|mesh.glb>          Write a chunked binary mesh or GLB file\n"
+              << "  run --out-of-core <mesh.mbin> [memory cap MB]      Stream stats, bounds, normals and a point test\n"
+              << "  run --tile <mesh.json> <mesh.tiles> [grid size]    Write a spatially tiled mesh with LODs\n"
+              << "  run --partition <mesh> <mesh.mbin> [partitions]    Reorder triangles into compact partitions, .glb output too\n"
+              << "  run --bench-read <mesh.json|mesh.obj> [runs]       Compare read and mesh cache restore times\n"
+              << "  run --bench-pages <mesh> [runs]                    Time mesh kernels with and without huge pages\n"
+              << "  run --batch <input dir> <output dir> [mbin|glb]    Convert and measure a directory of meshes\n"
+              << "  run --sequence <mesh.seq> <fps> <frame meshes...>  Combine meshes with shared triangles into a sequence\n"
+              << "  run --live <shared memory name>                    Start the viewer on a mesh streamed by another process\n"
+              << "  run --record <events file>                         Start the viewer and record its input\n"
+              << "  run --replay <events file> [report.json]           Replay recorded input without vsync and report frame times\n"
+              << "  run --bench-live [vertex count] [frames]           Measure shared memory streaming latency\n"
+              << "  run --headless <mesh> [frames] [image.ppm]         Time offscreen rendering through EGL without a display\n"
+              << "  run --scaling [max triangles]                      Check that mesh kernels grow within their complexity\n"
+              << "  run --counters <command>                           Add hardware counters to --batch, --partition and --scaling\n"
+              << "  run --block-reader [command]                       Read plain JSON through the pipelined block reader\n"
+              << "  run --metrics-port <port> [command]                Serve Prometheus metrics on 127.0.0.1 while running\n";
+}
+
+// Parses argv[index] as a positive number, leaving value as it is when there is no such argument.
+// Returns false on anything else, where std::stoi would throw and abort the process
+template<typename T>
+static bool ParseArgument(int argc, char* argv[], int index, T& value)
+{
+    if (index >= argc)
+        return true;
+
+    const char* text = argv[index];
+    const char* end = text + strlen(text);
+    T parsed;
+    if constexpr (std::is_floating_point_v<T>)
+    {
+        // Floating point from_chars is missing from older standard libraries
+        char* parsedEnd;
+        parsed = strtof(text, &parsedEnd);
+        if (parsedEnd == text || parsedEnd != end || !std::isfinite(parsed))
+            return false;
+    }
+    else
+    {
+        auto [parsedEnd, error] = std::from_chars(text, end, parsed);
+        if (error != std::errc() || parsedEnd != end)
+            return false;
+    }
+
+    if (parsed <= 0)
+        return false;
+
+    value = parsed;
+    return true;
+}
+
+static int RunConvert(const char* inputPath, const char* outputPath)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    Mesh mesh(inputPath);
+    auto loadTime = std::chrono::steady_clock::now();
+
+    bool didWrite = std::filesystem::path(outputPath).extension() == ".glb" ? WriteGlb(mesh, outputPath) : WriteBinaryMesh(mesh, outputPath);
+    auto writeTime = std::chrono::steady_clock::now();
+
+    std::cout << "Loaded in " << std::chrono::duration<double, std::milli>(loadTime - startTime).count() << " ms, written in "
+              << std::chrono::duration<double, std::milli>(writeTime - loadTime).count() << " ms" << std::endl;
+    return didWrite ? 0 : 1;
+}
+
+static int RunTile(const char* inputPath, const char* outputPath, int gridSize)
+{
+    Mesh mesh(inputPath);
+    return WriteTiledMesh(mesh, outputPath, gridSize) ? 0 : 1;
+}
+
+static int RunOutOfCore(const char* path, size_t memoryCapMB)
+{
+    OutOfCoreMesh mesh(path, memoryCapMB * 1024 * 1024);
+    std::cout << mesh.header.vertexCount << " vertices, " << mesh.header.indexCount / 3 << " triangles" << std::endl;
+
+    Bounds bounds = mesh.CalculateBounds();
+    std::cout << "Bounds: (" << bounds.min.x << ", " << bounds.min.y << ", " << bounds.min.z << ") - ("
+              << bounds.max.x << ", " << bounds.max.y << ", " << bounds.max.z << ")" << std::endl;
+
+    TriangleStatistics stats = mesh.CalculateStatistics();
+    std::cout << "Triangle Area Statistics:\nMax: " << stats.maxArea << "\nMin: " << stats.minArea << "\nAvg: " << stats.avgArea << std::endl;
+
+    std::string normalsPath = std::string(path) + ".normals";
+    mesh.CalculateNormals(normalsPath.c_str());
+    std::cout << "Normals written to " << normalsPath << std::endl;
+
+    const glm::vec3 point = glm::vec3(0.10f, 0.20f, 0.30f);
+    std::cout << "Is point inside the mesh: " << (mesh.IsPointInside(point) ? "Yes" : "No") << std::endl;
+    return 0;
+}
+
+enum class BenchReader
+{
+    FileReadStream,
+    Pread,
+    IoUring,
+};
+
+// Parses the file with the given reader and returns MB/s, OBJ files go through the chunked OBJ parser
+static double MeasureReadThroughput(const char* path, BenchReader benchReader)
+{
+    blockReaderSettings.useIoUring = benchReader == BenchReader::IoUring;
+
+    auto startTime = std::chrono::steady_clock::now();
+    bool didRead;
+    if (std::filesystem::path(path).extension() == ".obj")
+    {
+        VertexArray vertices;
+        IndexArray indices;
+        bool hasNormals;
+        didRead = ReadObj(path, vertices, indices, hasNormals);
+    }
+    else
+    {
+        bool wasUsedForJson = blockReaderSettings.isUsedForJson;
+        blockReaderSettings.isUsedForJson = benchReader != BenchReader::FileReadStream;
+        rapidjson::Document doc;
+        didRead = ParseFileJson(path, doc) && !doc.HasParseError();
+        blockReaderSettings.isUsedForJson = wasUsedForJson;
+    }
+
+    blockReaderSettings.useIoUring = true;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return didRead ? std::filesystem::file_size(path) / (1024.0 * 1024.0) / seconds : 0;
+}
+
+static int RunBenchRead(const char* path, int runCount)
+{
+    if (!std::filesystem::exists(path))
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        return 1;
+    }
+
+    bool canDropCache = DropFileCache(path);
+    if (!canDropCache)
+        std::cout << "Dropping the page cache is not supported here, cold runs are skipped" << std::endl;
+
+    bool canUseIoUring = BlockReader(path).IsUsingIoUring();
+    if (!canUseIoUring)
+        std::cout << "io_uring is not available here, reads fall back to pread" << std::endl;
+
+    const char* readerNames[] = { "FileReadStream", "Pipelined pread", "Pipelined io_uring" };
+    for (BenchReader benchReader : { BenchReader::FileReadStream, BenchReader::Pread, BenchReader::IoUring })
+    {
+        if ((benchReader == BenchReader::FileReadStream && std::filesystem::path(path).extension() == ".obj")
+            || (benchReader == BenchReader::IoUring && !canUseIoUring))
+            continue;
+
+        double coldTotal = 0, warmTotal = 0;
+        for (int i = 0; i < runCount; i++)
+        {
+            if (canDropCache)
+            {
+                DropFileCache(path);
+                coldTotal += MeasureReadThroughput(path, benchReader);
+            }
+            warmTotal += MeasureReadThroughput(path, benchReader);
+        }
+
+        std::cout << readerNames[int(benchReader)] << ": ";
+        if (canDropCache)
+            std::cout << coldTotal / runCount << " MB/s cold, ";
+        std::cout << warmTotal / runCount << " MB/s warm" << std::endl;
+    }
+
+    // Round trip through the compressed tier of the mesh cache against loading the file again
+    auto loadStartTime = std::chrono::steady_clock::now();
+    std::unique_ptr<Mesh> mesh = Mesh::TryLoad(path);
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStartTime).count();
+    if (!mesh)
+        return 1;
+
+    MeshCache cache;
+    cache.settings.rawBudget = 0;
+    cache.Put(std::move(mesh));
+    MeshCacheStats stats = cache.GetStats();
+    mesh = cache.Take(path);
+
+    std::cout << "Mesh cache: " << stats.GetCompressionRatio() << "x compression, restored in " << cache.GetStats().lastRestoreMs
+              << " ms, loaded from file in " << loadMs << " ms" << std::endl;
+    return mesh ? 0 : 1;
+}
+
+static int RunPartition(const char* inputPath, const char* outputPath, int partitionCount)
+{
+    Mesh mesh(inputPath);
+
+    auto startTime = std::chrono::steady_clock::now();
+    MeshPartitioning partitioning = PartitionMesh(mesh.vertices, mesh.indices, partitionCount);
+    double partitionMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    uint32_t largestPartition = 0;
+    for (int p = 0; p < partitioning.partitionCount; p++)
+        largestPartition = std::max(largestPartition, partitioning.triangleOffsets[p + 1] - partitioning.triangleOffsets[p]);
+
+    size_t triangleCount = mesh.indices.size() / 3;
+    size_t boundaryCount = mesh.vertices.size() - partitioning.GetBoundaryVertexStart();
+    std::cout << partitioning.partitionCount << " partitions in " << partitionMs << " ms, " << partitioning.edgeCut << " cut edges, "
+              << 100.0 * boundaryCount / mesh.vertices.size() << "% boundary vertices, largest partition "
+              << double(largestPartition) * partitioning.partitionCount / triangleCount << "x the average" << std::endl;
+
+    // Both passes calculate only the normals on the mesh itself, the vertices are put back afterwards so normals
+    // stored in the file are written as they were
+    VertexArray fileVertices = mesh.vertices;
+    PerfCounters counters;
+    counters.Start();
+    startTime = std::chrono::steady_clock::now();
+    CalculateSerialNormals(mesh.vertices, mesh.indices);
+    double serialMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    PerfCounterValues serialCounters = counters.Stop();
+
+    counters.Start();
+    startTime = std::chrono::steady_clock::now();
+    CalculatePartitionedNormals(mesh.vertices, mesh.indices, partitioning);
+    double partitionedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    PerfCounterValues partitionedCounters = counters.Stop();
+    mesh.vertices = std::move(fileVertices);
+
+    std::cout << "Normals serial: " << serialMs << " ms" << std::endl;
+    PrintPerfCounters(serialCounters, triangleCount);
+    std::cout << "Normals partitioned: " << partitionedMs << " ms" << std::endl;
+    PrintPerfCounters(partitionedCounters, triangleCount);
+
+    bool didWrite = std::filesystem::path(outputPath).extension() == ".glb" ? WriteGlb(mesh, outputPath) : WriteBinaryMesh(mesh, outputPath);
+    return didWrite ? 0 : 1;
+}
+
+// Loads the mesh again for every run so its arrays are allocated under the setting being measured. The
+// settings alternate between runs, so warming up the process does not favor the one measured first
+static int RunBenchHugePages(const char* path, int runCount)
+{
+    // dTLB misses are what huge pages change, so counters are collected without --counters
+    perfCounterSettings.isEnabled = true;
+    const glm::vec3 point = glm::vec3(0.10f, 0.20f, 0.30f);
+    const bool useHugePages = meshAllocatorSettings.useHugePages;
+
+    constexpr int kernelCount = 3;
+    const char* kernelNames[kernelCount] = { "Normals", "IsPointInside", "Subdivide" };
+    double kernelMs[2][kernelCount] = {};
+    PerfCounterValues kernelCounters[2][kernelCount];
+    size_t triangleCount = 0;
+    for (int run = 0; run < runCount; run++)
+    {
+        for (int isHugePages = 0; isHugePages < 2; isHugePages++)
+        {
+            meshAllocatorSettings.useHugePages = isHugePages;
+            std::unique_ptr<Mesh> mesh = Mesh::TryLoad(path);
+            if (!mesh)
+                return 1;
+
+            triangleCount = mesh->indexCount / 3;
+            const std::function<void()> kernels[kernelCount] = { [&] { mesh->RecalculateNormals(); },
+                [&] { mesh->IsPointInside(point); }, [&] { mesh->Subdivide(); } };
+            for (int i = 0; i < kernelCount; i++)
+            {
+                PerfCounters counters;
+                counters.Start();
+                auto startTime = std::chrono::steady_clock::now();
+                kernels[i]();
+                kernelMs[isHugePages][i] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+                kernelCounters[isHugePages][i] += counters.Stop();
+            }
+        }
+    }
+
+    meshAllocatorSettings.useHugePages = useHugePages;
+
+    bool hasCounters = false;
+    for (int isHugePages = 1; isHugePages >= 0; isHugePages--)
+    {
+        std::cout << (isHugePages ? "Huge pages:" : "Regular pages:") << std::endl;
+        for (int i = 0; i < kernelCount; i++)
+        {
+            std::cout << "  " << kernelNames[i] << ": " << kernelMs[isHugePages][i] / runCount << " ms" << std::endl;
+            PrintPerfCounters(kernelCounters[isHugePages][i], triangleCount * runCount);
+            hasCounters = hasCounters || kernelCounters[isHugePages][i].IsAnyAvailable();
+        }
+    }
+
+    if (!hasCounters)
+        std::cerr << "Hardware counters are not available here (perf_event_paranoid or container limits), only times are reported"
+                  << std::endl;
+    return 0;
+}
+
+bool RunCommandLine(int argc, char* argv[], int& exitCode, ViewerOptions& options)
+{
+    if (argc < 2)
+        return false;
+
+    // Serves the viewer or the command that follows, which starts the viewer when there is none
+    if (strcmp(argv[1], "--metrics-port") == 0 && argc >= 3)
+    {
+        int port = 0;
+        if (!ParseArgument(argc, argv, 2, port) || port > 65535)
+        {
+            PrintUsage();
+            exitCode = 1;
+            return true;
+        }
+
+        if (!StartMetricsServer(port))
+        {
+            exitCode = 1;
+            return true;
+        }
+
+        argc -= 2;
+        argv += 2;
+        if (argc < 2)
+            return false;
+    }
+
+    // Applies to any benchmark command that follows
+    if (argc >= 2 && strcmp(argv[1], "--counters") == 0)
+    {
+        perfCounterSettings.isEnabled = true;
+        argc--;
+        argv++;
+    }
+
+    // Applies to the command or viewer that follows
+    if (argc >= 2 && strcmp(argv[1], "--block-reader") == 0)
+    {
+        blockReaderSettings.isUsedForJson = true;
+        argc--;
+        argv++;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--live") == 0 && argc == 3)
+    {
+        options.liveMeshName = argv[2];
+        return false;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--record") == 0 && argc == 3)
+    {
+        options.recordPath = argv[2];
+        return false;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--replay") == 0 && (argc == 3 || argc == 4))
+    {
+        options.replayPath = argv[2];
+        options.replayReportPath = argc == 4 ? argv[3] : "replay_report.json";
+        return false;
+    }
+
+    // Optional numbers keep these defaults, a malformed one falls through to the usage
+    size_t memoryCapMB = 256;
+    size_t maxTriangleCount = 512 * 1024;
+    size_t liveVertexCount = 100000;
+    int liveFrameCount = 500;
+    int gridSize = 4;
+    int partitionCount = std::max(1u, std::thread::hardware_concurrency());
+    int headlessFrameCount = 100;
+    int runCount = 3;
+    float fps = 0;
+
+    if (argc < 2)
+    {
+        PrintUsage();
+        exitCode = 1;
+    }
+    else if (strcmp(argv[1], "--convert") == 0 && argc == 4)
+        exitCode = RunConvert(argv[2], argv[3]);
+    else if (strcmp(argv[1], "--out-of-core") == 0 && (argc == 3 || argc == 4) && ParseArgument(argc, argv, 3, memoryCapMB))
+        exitCode = RunOutOfCore(argv[2], memoryCapMB);
+    else if (strcmp(argv[1], "--tile") == 0 && (argc == 4 || argc == 5) && ParseArgument(argc, argv, 4, gridSize))
+        exitCode = RunTile(argv[2], argv[3], gridSize);
+    else if (strcmp(argv[1], "--batch") == 0 && (argc == 4 || argc == 5))
+        exitCode = RunBatch(argv[2], argv[3], argc == 5 ? argv[4] : "mbin");
+    else if (strcmp(argv[1], "--sequence") == 0 && argc >= 5 && ParseArgument(argc, argv, 3, fps))
+        exitCode = WriteMeshSequence(std::vector<std::string>(argv + 4, argv + argc), argv[2], fps) ? 0 : 1;
+    else if (strcmp(argv[1], "--bench-live") == 0 && argc <= 4 && ParseArgument(argc, argv, 2, liveVertexCount)
+             && ParseArgument(argc, argv, 3, liveFrameCount))
+        exitCode = RunSharedMeshBenchmark(liveVertexCount, liveFrameCount);
+    else if (strcmp(argv[1], "--partition") == 0 && (argc == 4 || argc == 5) && ParseArgument(argc, argv, 4, partitionCount))
+        exitCode = RunPartition(argv[2], argv[3], partitionCount);
+    else if (strcmp(argv[1], "--headless") == 0 && argc >= 3 && argc <= 5 && ParseArgument(argc, argv, 3, headlessFrameCount))
+        exitCode = RunHeadless(argv[2], headlessFrameCount, argc == 5 ? argv[4] : nullptr);
+    else if (strcmp(argv[1], "--scaling") == 0 && argc <= 3 && ParseArgument(argc, argv, 2, maxTriangleCount))
+        exitCode = RunScalingCheck(maxTriangleCount);
+    else if (strcmp(argv[1], "--bench-read") == 0 && (argc == 3 || argc == 4) && ParseArgument(argc, argv, 3, runCount))
+        exitCode = RunBenchRead(argv[2], runCount);
+    else if (strcmp(argv[1], "--bench-pages") == 0 && (argc == 3 || argc == 4) && ParseArgument(argc, argv, 3, runCount))
+        exitCode = RunBenchHugePages(argv[2], runCount);
+    else
+    {
+        PrintUsage();
+        exitCode = 1;
+    }
+
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+// Viewer settings taken from the command line
+struct ViewerOptions
+{
+    // Shared memory ring to show instead of a mesh file, empty when not live
+    std::string liveMeshName;
+
+    // Session input is written to the record path, or read from the replay path instead of live input
+    std::string recordPath;
+    std::string replayPath;
+    std::string replayReportPath;
+};
+
+// Runs a command line mode if one was requested, returns false to start the viewer with the options
+bool RunCommandLine(int argc, char* argv[], int& exitCode, ViewerOptions& options);
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/prettywriter.h"
+
+#include "event_recording.h"
+
+EventRecorder::EventRecorder(const char* path)
+    : file(fopen(path, "wb")), startTime(std::chrono::steady_clock::now())
+{
+    if (!file)
+    {
+        std::cerr << "Failed to open recording file " << path << std::endl;
+        return;
+    }
+
+    EventRecordingHeader header = {};
+    memcpy(header.magic, "EREC", 4);
+    header.version = eventRecordingVersion;
+    header.eventSize = sizeof(SDL_Event);
+    fwrite(&header, sizeof(header), 1, file);
+}
+
+EventRecorder::~EventRecorder()
+{
+    if (file)
+        fclose(file);
+}
+
+void EventRecorder::RecordFrame(float deltaTime, const SDL_Event* event)
+{
+    if (!file)
+        return;
+
+    RecordedFrame frame = {};
+    frame.deltaTime = deltaTime;
+    frame.hasEvent = event != nullptr;
+    frame.recordedMs = uint32_t(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    if (event)
+        frame.event = *event;
+
+    fwrite(&frame, sizeof(frame), 1, file);
+}
+
+EventReplayer::EventReplayer(const char* path)
+    : isValid(false), nextFrame(0)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        std::cerr << "Failed to open recording file " << path << std::endl;
+        return;
+    }
+
+    EventRecordingHeader header;
+    isValid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "EREC", 4) == 0 && header.version == eventRecordingVersion
+              && header.eventSize == sizeof(SDL_Event);
+
+    // A session that ended without closing the file keeps its complete frames
+    RecordedFrame frame;
+    while (isValid && fread(&frame, sizeof(frame), 1, file) == 1)
+        frames.push_back(frame);
+
+    fclose(file);
+    if (!isValid)
+        std::cerr << "Invalid event recording format" << std::endl;
+
+    frameTimes.reserve(frames.size());
+}
+
+bool EventReplayer::NextFrame(RecordedFrame& frame)
+{
+    if (nextFrame == frames.size())
+        return false;
+
+    frame = frames[nextFrame++];
+    return true;
+}
+
+void EventReplayer::AddFrameTime(double frameMs)
+{
+    frameTimes.push_back(frameMs);
+}
+
+bool EventReplayer::WriteReport(const char* path) const
+{
+    if (frameTimes.empty())
+    {
+        std::cerr << "No frames were replayed" << std::endl;
+        return false;
+    }
+
+    std::vector<double> sortedTimes = frameTimes;
+    std::sort(sortedTimes.begin(), sortedTimes.end());
+    double totalMs = 0;
+    for (double frameMs : frameTimes)
+        totalMs += frameMs;
+
+    auto getQuantile = [&](double quantile) { return sortedTimes[std::min(sortedTimes.size() - 1, size_t(quantile * sortedTimes.size()))]; };
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to write report" << std::endl;
+        return false;
+    }
+
+    char buffer[65536];
+    rapidjson::FileWriteStream outputStream(file, buffer, sizeof(buffer));
+    rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(outputStream);
+
+    writer.StartObject();
+    writer.Key("frames");
+    writer.StartArray();
+    for (size_t i = 0; i < frameTimes.size(); i++)
+    {
+        writer.StartObject();
+        writer.Key("frameMs");
+        writer.Double(frameTimes[i]);
+        writer.Key("recordedMs");
+        writer.Uint(frames[i].recordedMs);
+        writer.Key("hasEvent");
+        writer.Bool(frames[i].hasEvent);
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    writer.Key("summary");
+    writer.StartObject();
+    writer.Key("frameCount");
+    writer.Uint64(frameTimes.size());
+    writer.Key("totalMs");
+    writer.Double(totalMs);
+    writer.Key("avgMs");
+    writer.Double(totalMs / frameTimes.size());
+    writer.Key("medianMs");
+    writer.Double(getQuantile(0.5));
+    writer.Key("p95Ms");
+    writer.Double(getQuantile(0.95));
+    writer.Key("p99Ms");
+    writer.Double(getQuantile(0.99));
+    writer.Key("maxMs");
+    writer.Double(sortedTimes.back());
+    writer.EndObject();
+    writer.EndObject();
+
+    outputStream.Flush();
+    fclose(file);
+
+    std::cout << frameTimes.size() << " frames replayed in " << totalMs << " ms, avg " << totalMs / frameTimes.size() << " ms, median "
+              << getQuantile(0.5) << " ms, p99 " << getQuantile(0.99) << " ms, max " << sortedTimes.back() << " ms, report written to "
+              << path << std::endl;
+    return true;
+}
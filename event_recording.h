@@ -0,0 +1,77 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Event recording layout:
+// header | per frame: RecordedFrame
+// The viewer handles at most one event per frame, so a frame stores the delta time it ran with and
+// that event. Events are stored as raw SDL_Event bytes and only replay with the SDL version that recorded them
+constexpr uint32_t eventRecordingVersion = 1;
+
+struct EventRecordingHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t eventSize;
+    uint32_t padding;
+};
+
+struct RecordedFrame
+{
+    float deltaTime;
+    uint32_t hasEvent;
+
+    // Milliseconds since the recording started, for reference against the replayed timings
+    uint32_t recordedMs;
+    uint32_t padding;
+    SDL_Event event;
+};
+
+// Appends the frames of a viewer session to a file
+class EventRecorder
+{
+public:
+    EventRecorder(const char* path);
+    ~EventRecorder();
+
+    EventRecorder(const EventRecorder&) = delete;
+    EventRecorder& operator=(const EventRecorder&) = delete;
+
+    bool IsValid() const { return file != nullptr; }
+
+    // Event is nullptr for frames that handled none
+    void RecordFrame(float deltaTime, const SDL_Event* event);
+
+private:
+    FILE* file;
+    std::chrono::steady_clock::time_point startTime;
+};
+
+// Feeds a recorded session back frame by frame and collects the time every replayed frame took
+class EventReplayer
+{
+public:
+    EventReplayer(const char* path);
+
+    bool IsValid() const { return isValid; }
+
+    // Returns false once all frames were replayed
+    bool NextFrame(RecordedFrame& frame);
+
+    // Time the last replayed frame took
+    void AddFrameTime(double frameMs);
+
+    // Writes per frame timings and their summary as JSON and prints the summary
+    bool WriteReport(const char* path) const;
+
+private:
+    bool isValid;
+    std::vector<RecordedFrame> frames;
+    size_t nextFrame;
+    std::vector<double> frameTimes;
+};
@@ -0,0 +1,106 @@
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "file_watcher.h"
+
+constexpr int pollIntervalMs = 100;
+
+FileWatcher::FileWatcher(const std::filesystem::path& path, int debounceMs)
+    : path(path), debounce(debounceMs), hasChanged(false), isStopping(false)
+{
+#ifdef __linux__
+    // Watch the directory since exporters often write a temporary file and rename it over the original
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0)
+        std::cerr << "Failed to watch " << directory << std::endl;
+#else
+    std::error_code error;
+    lastWriteTime = std::filesystem::last_write_time(path, error);
+#endif
+
+    thread = std::thread(&FileWatcher::Run, this);
+}
+
+FileWatcher::~FileWatcher()
+{
+    isStopping = true;
+    thread.join();
+
+#ifdef __linux__
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+#endif
+}
+
+bool FileWatcher::PollChanged()
+{
+    return hasChanged.exchange(false);
+}
+
+void FileWatcher::Run()
+{
+    bool isPending = false;
+    auto lastEventTime = std::chrono::steady_clock::now();
+
+    while (!isStopping)
+    {
+        if (WaitForEvent())
+        {
+            isPending = true;
+            lastEventTime = std::chrono::steady_clock::now();
+        }
+        else if (isPending && std::chrono::steady_clock::now() - lastEventTime >= debounce)
+        {
+            isPending = false;
+            hasChanged = true;
+        }
+    }
+}
+
+// Waits up to one poll interval and returns whether the watched file changed
+bool FileWatcher::WaitForEvent()
+{
+#ifdef __linux__
+    if (inotifyFd < 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMs));
+        return false;
+    }
+
+    pollfd pollFd = { inotifyFd, POLLIN, 0 };
+    if (poll(&pollFd, 1, pollIntervalMs) <= 0)
+        return false;
+
+    alignas(inotify_event) char buffer[4096];
+    bool didChange = false;
+    ssize_t length;
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+    {
+        for (char* p = buffer; p < buffer + length;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            if (event->len > 0 && path.filename() == event->name)
+                didChange = true;
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    return didChange;
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(pollIntervalMs));
+
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(path, error);
+    if (error || writeTime == lastWriteTime)
+        return false;
+
+    lastWriteTime = writeTime;
+    return true;
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+// Watches a single file for rewrites on a background thread, with inotify on Linux and
+// modification time polling elsewhere. Bursts of changes are debounced into one notification
+class FileWatcher
+{
+public:
+    FileWatcher(const std::filesystem::path& path, int debounceMs = 300);
+    ~FileWatcher();
+
+    // True once after the file has changed and then stayed unchanged for the debounce interval
+    bool PollChanged();
+
+private:
+    std::filesystem::path path;
+    std::chrono::milliseconds debounce;
+    std::atomic<bool> hasChanged;
+    std::atomic<bool> isStopping;
+    std::thread thread;
+
+#ifdef __linux__
+    int inotifyFd;
+#else
+    std::filesystem::file_time_type lastWriteTime;
+#endif
+
+    void Run();
+    bool WaitForEvent();
+};
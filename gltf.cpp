@@ -0,0 +1,469 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include "gltf.h"
+
+constexpr uint32_t glbMagic = 0x46546C67;
+constexpr uint32_t glbChunkJson = 0x4E4F534A;
+constexpr uint32_t glbChunkBin = 0x004E4942;
+
+constexpr int componentFloat = 5126;
+constexpr int componentUnsignedInt = 5125;
+constexpr int componentUnsignedShort = 5123;
+constexpr int componentUnsignedByte = 5121;
+
+constexpr int targetArrayBuffer = 34962;
+constexpr int targetElementArrayBuffer = 34963;
+
+struct GlbAccessor
+{
+    const char* data;
+    size_t count;
+    size_t stride;
+    int componentType;
+    int bufferView;
+    size_t offset;
+};
+
+static size_t GetComponentSize(int componentType)
+{
+    switch (componentType)
+    {
+    case componentFloat:
+    case componentUnsignedInt:
+        return 4;
+    case componentUnsignedShort:
+        return 2;
+    case componentUnsignedByte:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Reads an optional non-negative integer member, false when it is present with another type
+static bool GetSizeMember(const rapidjson::Value& object, const char* key, size_t& value, size_t defaultValue = 0)
+{
+    if (!object.HasMember(key))
+    {
+        value = defaultValue;
+        return true;
+    }
+
+    if (!object[key].IsUint64())
+        return false;
+
+    value = object[key].GetUint64();
+    return true;
+}
+
+// Reads an index into one of the document's top level arrays
+static bool GetIndexMember(const rapidjson::Value& object, const char* key, int& value)
+{
+    if (!object.HasMember(key) || !object[key].IsInt() || object[key].GetInt() < 0)
+        return false;
+
+    value = object[key].GetInt();
+    return true;
+}
+
+// Resolves an accessor to a pointer into the binary chunk, checking it stays in range
+static bool GetAccessor(const rapidjson::Document& doc, int index, const char* expectedType, const char* bin, size_t binLength, GlbAccessor& accessor)
+{
+    if (!doc.HasMember("accessors") || !doc["accessors"].IsArray() || index < 0 || index >= (int)doc["accessors"].Size())
+        return false;
+
+    const rapidjson::Value& accessorObject = doc["accessors"][index];
+    if (!accessorObject.IsObject() || !accessorObject.HasMember("type") || !accessorObject["type"].IsString()
+        || strcmp(accessorObject["type"].GetString(), expectedType) != 0)
+        return false;
+
+    if (!GetIndexMember(accessorObject, "bufferView", accessor.bufferView) || !GetIndexMember(accessorObject, "componentType", accessor.componentType)
+        || !accessorObject.HasMember("count") || !GetSizeMember(accessorObject, "count", accessor.count) || !GetSizeMember(accessorObject, "byteOffset", accessor.offset))
+        return false;
+
+    if (!doc.HasMember("bufferViews") || !doc["bufferViews"].IsArray() || accessor.bufferView >= (int)doc["bufferViews"].Size())
+        return false;
+
+    const rapidjson::Value& view = doc["bufferViews"][accessor.bufferView];
+    size_t componentCount = strcmp(expectedType, "VEC3") == 0 ? 3 : 1;
+    size_t elementSize = GetComponentSize(accessor.componentType) * componentCount;
+    size_t viewOffset;
+    size_t viewLength;
+    if (!view.IsObject() || !view.HasMember("byteLength") || !GetSizeMember(view, "byteOffset", viewOffset) || !GetSizeMember(view, "byteLength", viewLength)
+        || !GetSizeMember(view, "byteStride", accessor.stride, elementSize))
+        return false;
+
+    // Compared by subtraction so offsets near SIZE_MAX cannot wrap around
+    if (elementSize == 0 || accessor.stride < elementSize || viewOffset > binLength || viewLength > binLength - viewOffset)
+        return false;
+    if (accessor.count > 0 && (accessor.offset > viewLength || viewLength - accessor.offset < elementSize
+        || accessor.count - 1 > (viewLength - accessor.offset - elementSize) / accessor.stride))
+        return false;
+
+    accessor.data = bin + viewOffset + accessor.offset;
+    return true;
+}
+
+bool ReadGlb(const char* path, VertexArray& vertices, IndexArray& indices, bool& hasNormals)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        std::cerr << "Failed to read GLB file size" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = fileStat.st_size;
+
+    const char* mapped = fileSize >= 20 ? static_cast<const char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0)) : nullptr;
+    close(fd);
+
+    if (!mapped || mapped == MAP_FAILED)
+    {
+        std::cerr << "Failed to map GLB file" << std::endl;
+        return false;
+    }
+
+    // The mapping is released on every return path
+    struct Unmap
+    {
+        const char* data;
+        size_t size;
+        ~Unmap() { munmap(const_cast<char*>(data), size); }
+    } unmap = { mapped, fileSize };
+
+    uint32_t header[3];
+    uint32_t jsonChunk[2];
+    memcpy(header, mapped, sizeof(header));
+    memcpy(jsonChunk, mapped + 12, sizeof(jsonChunk));
+
+    if (header[0] != glbMagic || header[1] != 2 || header[2] > fileSize || jsonChunk[1] != glbChunkJson || 20 + size_t(jsonChunk[0]) > fileSize)
+    {
+        std::cerr << "Invalid GLB format" << std::endl;
+        return false;
+    }
+
+    const char* bin = nullptr;
+    size_t binLength = 0;
+    size_t binChunkOffset = 20 + size_t(jsonChunk[0]);
+    if (binChunkOffset + 8 <= fileSize)
+    {
+        uint32_t binChunk[2];
+        memcpy(binChunk, mapped + binChunkOffset, sizeof(binChunk));
+        if (binChunk[1] == glbChunkBin && binChunkOffset + 8 + binChunk[0] <= fileSize)
+        {
+            bin = mapped + binChunkOffset + 8;
+            binLength = binChunk[0];
+        }
+    }
+
+    rapidjson::Document doc;
+    doc.Parse(mapped + 20, jsonChunk[0]);
+
+    if (doc.HasParseError() || !doc.IsObject() || !bin)
+    {
+        std::cerr << "Invalid GLB format" << std::endl;
+        return false;
+    }
+
+    if (!doc.HasMember("meshes") || !doc["meshes"].IsArray() || doc["meshes"].Empty() || !doc["meshes"][0].IsObject()
+        || !doc["meshes"][0].HasMember("primitives") || !doc["meshes"][0]["primitives"].IsArray() || doc["meshes"][0]["primitives"].Empty())
+    {
+        std::cerr << "GLB file has no mesh" << std::endl;
+        return false;
+    }
+
+    const rapidjson::Value& primitive = doc["meshes"][0]["primitives"][0];
+    size_t mode;
+    if (!primitive.IsObject() || !GetSizeMember(primitive, "mode", mode, 4) || mode != 4 || !primitive.HasMember("attributes")
+        || !primitive["attributes"].IsObject())
+    {
+        std::cerr << "Unsupported GLB primitive" << std::endl;
+        return false;
+    }
+
+    const rapidjson::Value& attributes = primitive["attributes"];
+    int positionIndex;
+    GlbAccessor positions;
+    if (!GetIndexMember(attributes, "POSITION", positionIndex) || !GetAccessor(doc, positionIndex, "VEC3", bin, binLength, positions)
+        || positions.componentType != componentFloat)
+    {
+        std::cerr << "Invalid POSITION accessor" << std::endl;
+        return false;
+    }
+
+    int normalIndex;
+    GlbAccessor normals;
+    hasNormals = GetIndexMember(attributes, "NORMAL", normalIndex) && GetAccessor(doc, normalIndex, "VEC3", bin, binLength, normals)
+        && normals.componentType == componentFloat && normals.count == positions.count;
+
+    vertices.resize(positions.count);
+    if (hasNormals && normals.bufferView == positions.bufferView && positions.stride == sizeof(Vertex) && normals.stride == sizeof(Vertex)
+        && normals.offset == positions.offset + offsetof(Vertex, normal))
+    {
+        // Same interleaved layout as Vertex, take the whole view in one copy
+        memcpy(vertices.data(), positions.data, positions.count * sizeof(Vertex));
+    }
+    else
+    {
+        for (size_t i = 0; i < positions.count; i++)
+        {
+            memcpy(&vertices[i].position, positions.data + i * positions.stride, sizeof(glm::vec3));
+            if (hasNormals)
+                memcpy(&vertices[i].normal, normals.data + i * normals.stride, sizeof(glm::vec3));
+        }
+    }
+
+    if (!primitive.HasMember("indices"))
+    {
+        // Non-indexed triangle list
+        indices.resize(positions.count - positions.count % 3);
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = i;
+        return true;
+    }
+
+    int indicesIndex;
+    GlbAccessor indexAccessor;
+    if (!GetIndexMember(primitive, "indices", indicesIndex) || !GetAccessor(doc, indicesIndex, "SCALAR", bin, binLength, indexAccessor)
+        || indexAccessor.componentType == componentFloat)
+    {
+        std::cerr << "Invalid indices accessor" << std::endl;
+        return false;
+    }
+
+    indices.resize(indexAccessor.count);
+    if (indexAccessor.componentType == componentUnsignedInt && indexAccessor.stride == sizeof(uint32_t))
+    {
+        memcpy(indices.data(), indexAccessor.data, indexAccessor.count * sizeof(uint32_t));
+    }
+    else
+    {
+        for (size_t i = 0; i < indexAccessor.count; i++)
+        {
+            const char* element = indexAccessor.data + i * indexAccessor.stride;
+            if (indexAccessor.componentType == componentUnsignedInt)
+                memcpy(&indices[i], element, sizeof(uint32_t));
+            else if (indexAccessor.componentType == componentUnsignedShort)
+                indices[i] = *reinterpret_cast<const uint16_t*>(element);
+            else
+                indices[i] = *reinterpret_cast<const uint8_t*>(element);
+        }
+    }
+
+    for (int index : indices)
+    {
+        if (index < 0 || size_t(index) >= vertices.size())
+        {
+            std::cerr << "Invalid index format" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void WriteVec3(rapidjson::Writer<rapidjson::StringBuffer>& writer, glm::vec3 v)
+{
+    writer.StartArray();
+    writer.Double(v.x);
+    writer.Double(v.y);
+    writer.Double(v.z);
+    writer.EndArray();
+}
+
+// Leaves the accessor object open so callers can add min/max
+static void StartAccessor(rapidjson::Writer<rapidjson::StringBuffer>& writer, int bufferView, size_t byteOffset, int componentType, size_t count, const char* type)
+{
+    writer.StartObject();
+    writer.Key("bufferView");
+    writer.Int(bufferView);
+    writer.Key("byteOffset");
+    writer.Uint64(byteOffset);
+    writer.Key("componentType");
+    writer.Int(componentType);
+    writer.Key("count");
+    writer.Uint64(count);
+    writer.Key("type");
+    writer.String(type);
+}
+
+static void WriteBufferView(rapidjson::Writer<rapidjson::StringBuffer>& writer, size_t byteOffset, size_t byteLength, size_t byteStride, int target)
+{
+    writer.StartObject();
+    writer.Key("buffer");
+    writer.Int(0);
+    writer.Key("byteOffset");
+    writer.Uint64(byteOffset);
+    writer.Key("byteLength");
+    writer.Uint64(byteLength);
+    if (byteStride > 0)
+    {
+        writer.Key("byteStride");
+        writer.Uint64(byteStride);
+    }
+    writer.Key("target");
+    writer.Int(target);
+    writer.EndObject();
+}
+
+bool WriteGlb(const Mesh& mesh, const char* path)
+{
+    const VertexArray& vertices = mesh.vertices;
+    const IndexArray& indices = mesh.indices;
+
+    size_t vertexBytes = vertices.size() * sizeof(Vertex);
+    size_t indexBytes = indices.size() * sizeof(uint32_t);
+
+    rapidjson::StringBuffer json;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(json);
+
+    writer.StartObject();
+    writer.Key("asset");
+    writer.StartObject();
+    writer.Key("version");
+    writer.String("2.0");
+    writer.EndObject();
+
+    writer.Key("scene");
+    writer.Int(0);
+    writer.Key("scenes");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("nodes");
+    writer.StartArray();
+    writer.Int(0);
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndArray();
+
+    writer.Key("nodes");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("mesh");
+    writer.Int(0);
+    writer.EndObject();
+    writer.EndArray();
+
+    writer.Key("meshes");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("primitives");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("attributes");
+    writer.StartObject();
+    writer.Key("POSITION");
+    writer.Int(0);
+    writer.Key("NORMAL");
+    writer.Int(1);
+    writer.EndObject();
+    writer.Key("indices");
+    writer.Int(2);
+    writer.Key("mode");
+    writer.Int(4);
+    writer.EndObject();
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndArray();
+
+    // POSITION and NORMAL share the interleaved vertex view
+    writer.Key("accessors");
+    writer.StartArray();
+    StartAccessor(writer, 0, offsetof(Vertex, position), componentFloat, vertices.size(), "VEC3");
+    writer.Key("min");
+    WriteVec3(writer, mesh.bounds.min);
+    writer.Key("max");
+    WriteVec3(writer, mesh.bounds.max);
+    writer.EndObject();
+    StartAccessor(writer, 0, offsetof(Vertex, normal), componentFloat, vertices.size(), "VEC3");
+    writer.EndObject();
+    StartAccessor(writer, 1, 0, componentUnsignedInt, indices.size(), "SCALAR");
+    writer.EndObject();
+    writer.EndArray();
+
+    writer.Key("bufferViews");
+    writer.StartArray();
+    WriteBufferView(writer, 0, vertexBytes, sizeof(Vertex), targetArrayBuffer);
+    WriteBufferView(writer, vertexBytes, indexBytes, 0, targetElementArrayBuffer);
+    writer.EndArray();
+
+    writer.Key("buffers");
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("byteLength");
+    writer.Uint64(vertexBytes + indexBytes);
+    writer.EndObject();
+    writer.EndArray();
+    writer.EndObject();
+
+    // Chunks are 4 byte aligned, JSON is padded with spaces and binary data with zeros
+    size_t jsonLength = (json.GetSize() + 3) & ~size_t(3);
+    size_t binLength = vertexBytes + indexBytes;
+
+    // GLB stores the file and chunk lengths in 32 bits
+    if (12 + 8 + jsonLength + 8 + binLength > UINT32_MAX)
+    {
+        std::cerr << "Mesh is too large for a GLB file, which is limited to 4 GB" << std::endl;
+        return false;
+    }
+
+    uint32_t header[3] = { glbMagic, 2, uint32_t(12 + 8 + jsonLength + 8 + binLength) };
+    uint32_t jsonChunk[2] = { uint32_t(jsonLength), glbChunkJson };
+    uint32_t binChunk[2] = { uint32_t(binLength), glbChunkBin };
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open file for writing" << std::endl;
+        return false;
+    }
+
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(jsonChunk, sizeof(jsonChunk), 1, file);
+    fwrite(json.GetString(), 1, json.GetSize(), file);
+    fwrite("   ", 1, jsonLength - json.GetSize(), file);
+    fwrite(binChunk, sizeof(binChunk), 1, file);
+
+    // glTF requires unit normals while the mesh keeps them unnormalized, so vertices go out in normalized blocks
+    std::vector<Vertex> block;
+    for (size_t first = 0; first < vertices.size(); first += 64 * 1024)
+    {
+        block.assign(vertices.begin() + first, vertices.begin() + std::min(first + 64 * 1024, vertices.size()));
+        for (Vertex& vertex : block)
+        {
+            float length = glm::length(vertex.normal);
+            vertex.normal = length > 0 ? vertex.normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+
+        fwrite(block.data(), sizeof(Vertex), block.size(), file);
+    }
+
+    fwrite(indices.data(), sizeof(int), indices.size(), file);
+
+    bool didWrite = !ferror(file);
+    fclose(file);
+
+    if (!didWrite)
+        std::cerr << "Failed to write GLB file" << std::endl;
+
+    return didWrite;
+}
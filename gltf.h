@@ -0,0 +1,11 @@
+#pragma once
+
+#include "mesh.h"
+
+// Reads the first primitive of the first mesh in a GLB file. Interleaved position/normal
+// views that match the Vertex layout and 32-bit indices are copied from the mapped
+// binary chunk in one block, other layouts are gathered element by element
+bool ReadGlb(const char* path, VertexArray& vertices, IndexArray& indices, bool& hasNormals);
+
+// Writes vertices as one interleaved buffer view and indices as a second one in a single binary chunk
+bool WriteGlb(const Mesh& mesh, const char* path);
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "headless.h"
+#include "mesh.h"
+#include "render.h"
+#include "shader.h"
+
+#ifdef __linux__
+
+constexpr int headlessWidth = 1280;
+constexpr int headlessHeight = 720;
+
+// Frames drawn before timing starts, the first ones include shader compilation in the driver
+constexpr int warmupFrameCount = 5;
+
+struct HeadlessPass
+{
+    const char* name;
+    bool isWireframe;
+    bool isNormalRendering;
+};
+
+// Prefers the surfaceless platform, which needs neither a display nor a surface, and falls back to a
+// pbuffer on the default display. Returns false without a GL 3.2 core context
+static bool CreateContext(EGLDisplay& display, EGLContext& context, EGLSurface& surface)
+{
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        {
+            std::cerr << "Failed to initialize EGL" << std::endl;
+            return false;
+        }
+    }
+
+    const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        std::cerr << "No EGL config supports desktop OpenGL" << std::endl;
+        eglTerminate(display);
+        return false;
+    }
+
+    const EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_CONTEXT_OPENGL_PROFILE_MASK,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cerr << "Failed to create a GL 3.2 core context" << std::endl;
+        eglTerminate(display);
+        return false;
+    }
+
+    // Drawing goes to a framebuffer object, the pbuffer only exists for drivers without surfaceless contexts
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+        if (surface == EGL_NO_SURFACE || !eglMakeCurrent(display, surface, surface, context))
+        {
+            std::cerr << "Failed to make the EGL context current" << std::endl;
+            eglDestroyContext(display, context);
+            eglTerminate(display);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool WritePpm(const char* path, int width, int height)
+{
+    std::vector<unsigned char> pixels(width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open output file" << std::endl;
+        return false;
+    }
+
+    // GL rows start at the bottom
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    bool didWrite = true;
+    for (int y = height - 1; y >= 0 && didWrite; y--)
+        didWrite = fwrite(pixels.data() + size_t(y) * width * 3, 1, width * 3, file) == size_t(width) * 3;
+
+    fclose(file);
+    return didWrite;
+}
+
+int RunHeadless(const char* meshPath, int frameCount, const char* imagePath)
+{
+    std::unique_ptr<Mesh> mesh = Mesh::TryLoad(meshPath);
+    if (!mesh)
+        return 1;
+
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+    if (!CreateContext(display, context, surface))
+        return 1;
+
+    std::cout << "Renderer: " << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION) << std::endl;
+
+    uint framebuffer, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, headlessWidth, headlessHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, headlessWidth, headlessHeight);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+    int exitCode = 0;
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+        exitCode = 1;
+    }
+
+    uint vao, vbo, ibo;
+    GenerateBuffers(vao, vbo, ibo);
+    PopulateBuffers(mesh->vertices, mesh->indices, vao, vbo, ibo);
+
+    Shader solidShader("./shaders/shader.vert", "./shaders/shader.frag");
+    Shader wireframeShader("./shaders/shader.vert", "./shaders/wireframe.frag");
+    Shader normalsShader("./shaders/normal.vert", "./shaders/normal.frag", "./shaders/normal.geom");
+
+    // Same camera, transform and animation step as the viewer at 60 frames per second
+    glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), (float)headlessWidth / (float)headlessHeight, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(cameraPos, cameraPos + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 baseModel =
+        glm::rotate(glm::mat4(1.0f), -float(M_PI) / 2, glm::vec3(1.0f, 0.0f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.4f));
+    const float deltaTime = 1.0f / 60;
+
+    glViewport(0, 0, headlessWidth, headlessHeight);
+    glEnable(GL_DEPTH_TEST);
+
+    const HeadlessPass passes[] = { { "solid", false, false }, { "wireframe", true, false }, { "normals", false, true } };
+    printf("%zu triangles, %dx%d, %d frames per pass\n", mesh->indexCount / 3, headlessWidth, headlessHeight, frameCount);
+    for (const HeadlessPass& pass : passes)
+    {
+        if (exitCode != 0)
+            break;
+
+        float rotation = 0.0f;
+        std::vector<double> frameTimes;
+        for (int frame = 0; frame < warmupFrameCount + frameCount; frame++)
+        {
+            auto startTime = std::chrono::steady_clock::now();
+
+            glClearColor(0.045f, 0.045f, 0.045f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            rotation += deltaTime * M_PI * 5;
+            glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(rotation), glm::vec3(1.0f, 1.0f, 0.0f)) * baseModel;
+
+            Shader& currentShader = pass.isWireframe ? wireframeShader : solidShader;
+            glUseProgram(currentShader.id);
+            glBindVertexArray(vao);
+            SetSceneUniforms(currentShader, model, view, proj);
+            glPolygonMode(GL_FRONT_AND_BACK, pass.isWireframe ? GL_LINE : GL_FILL);
+            glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, nullptr);
+
+            if (pass.isNormalRendering)
+            {
+                glUseProgram(normalsShader.id);
+                SetSceneUniforms(normalsShader, model, view, proj);
+                glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, nullptr);
+            }
+
+            glBindVertexArray(0);
+
+            // There is no swap to pace frames, so each frame waits until the GPU finished it
+            glFinish();
+            if (frame >= warmupFrameCount)
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+        }
+
+        if (glGetError() != GL_NO_ERROR)
+        {
+            std::cerr << "GL error in the " << pass.name << " pass" << std::endl;
+            exitCode = 1;
+        }
+
+        if (!frameTimes.empty())
+        {
+            std::vector<double> sortedTimes = frameTimes;
+            std::sort(sortedTimes.begin(), sortedTimes.end());
+            double totalMs = 0;
+            for (double frameMs : frameTimes)
+                totalMs += frameMs;
+
+            printf("%-10s avg %8.3f ms, median %8.3f ms, p99 %8.3f ms, max %8.3f ms, %7.1f fps\n", pass.name, totalMs / frameTimes.size(),
+                sortedTimes[sortedTimes.size() / 2], sortedTimes[std::min(sortedTimes.size() - 1, sortedTimes.size() * 99 / 100)],
+                sortedTimes.back(), 1000.0 * frameTimes.size() / totalMs);
+        }
+
+        // The thumbnail is the last solid frame
+        if (imagePath && !pass.isWireframe && !pass.isNormalRendering && !WritePpm(imagePath, headlessWidth, headlessHeight))
+            exitCode = 1;
+    }
+
+    glDeleteProgram(solidShader.id);
+    glDeleteProgram(wireframeShader.id);
+    glDeleteProgram(normalsShader.id);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+    return exitCode;
+}
+
+#else
+
+int RunHeadless(const char* meshPath, int frameCount, const char* imagePath)
+{
+    std::cerr << "Headless rendering needs EGL, which only Linux builds use" << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,7 @@
+#pragma once
+
+// Renders the mesh with the viewer's shaders and draw calls into an offscreen framebuffer, through an EGL
+// context that needs no display (a surfaceless or pbuffer platform, Mesa llvmpipe works). Times frameCount
+// frames each of the solid, wireframe and normals passes, waiting for the GPU every frame, and writes the
+// last solid frame to imagePath as PPM when it is not null. Only Linux builds have EGL. Returns the exit code
+int RunHeadless(const char* meshPath, int frameCount, const char* imagePath);
@@ -7,6 +7,9 @@
 #include <GL/gl.h>
 #endif
 
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <memory>
@@ -20,47 +23,62 @@
 #include "rapidjson/document.h"
 #include "rapidjson/filereadstream.h"
 
+#include "allocation_tracker.h"
+#include "cli.h"
+#include "event_recording.h"
+#include "file_watcher.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_preloader.h"
+#include "mesh_sequence.h"
+#include "metrics.h"
+#include "motion_detail.h"
+#include "render.h"
 #include "shader.h"
+#include "shared_mesh.h"
+#include "tiled_mesh.h"
 
-void GenerateBuffers(uint& vao, uint& vbo, uint& ibo)
-{
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), nullptr);
-    glEnableVertexAttribArray(0);
-
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-    glEnableVertexAttribArray(1);
+static LatencyHistogram frameTimes("viewer_frame_seconds", "", "Time between the starts of consecutive frames.");
+static LatencyHistogram meshLoadTimes("viewer_mesh_load_seconds", "", "Time to load a picked mesh and upload it.");
+static MetricsCounter preloadedMeshLoads("viewer_mesh_loads_total", "source=\"preloader\"", "Picked meshes by where they came from.");
+static MetricsCounter cachedMeshLoads("viewer_mesh_loads_total", "source=\"cache\"", "");
+static MetricsCounter parsedMeshLoads("viewer_mesh_loads_total", "source=\"file\"", "");
+static LatencyHistogram pointQueryTimes("viewer_query_seconds", "query=\"point_inside\"", "Time of mesh queries run from the UI.");
+static LatencyHistogram estimateQueryTimes("viewer_query_seconds", "query=\"statistics_estimate\"", "");
 
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
-
-void PopulateBuffers(std::vector<Vertex>& vertices, const std::vector<int>& indices, uint& vao, uint& vbo, uint& ibo)
+int main(int argc, char* argv[])
 {
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &indices[0], GL_STATIC_DRAW);
+    int exitCode;
+    ViewerOptions options;
+    if (RunCommandLine(argc, argv, exitCode, options))
+    {
+        PrintAllocationReport();
+        StopMetricsServer();
+        return exitCode;
+    }
 
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
+    // Replays run the recorded frames as fast as possible with their recorded delta times
+    std::unique_ptr<EventRecorder> eventRecorder;
+    std::unique_ptr<EventReplayer> eventReplayer;
+    if (!options.replayPath.empty())
+    {
+        eventReplayer = std::make_unique<EventReplayer>(options.replayPath.c_str());
+        if (!eventReplayer->IsValid())
+        {
+            StopMetricsServer();
+            return 1;
+        }
+    }
+    else if (!options.recordPath.empty())
+    {
+        eventRecorder = std::make_unique<EventRecorder>(options.recordPath.c_str());
+        if (!eventRecorder->IsValid())
+        {
+            StopMetricsServer();
+            return 1;
+        }
+    }
 
-int main(int argc, char* argv[])
-{
     // Setup SDL with OpenGL
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -77,7 +95,7 @@ int main(int argc, char* argv[])
     SDL_GLContext context = SDL_GL_CreateContext(window);
     SDL_GLContext loaderContext = SDL_GL_CreateContext(window);
 
-    SDL_GL_SetSwapInterval(1);
+    SDL_GL_SetSwapInterval(eventReplayer ? 0 : 1);
     glViewport(0, 0, width, height);
 
     glEnable(GL_DEPTH_TEST);
@@ -107,23 +125,110 @@ int main(int argc, char* argv[])
     uint vao, vbo, ibo;
     GenerateBuffers(vao, vbo, ibo);
 
+    // Coarse stand-in for the mesh drawn while the camera moves, indexing the same vertex buffer
+    MotionDetail motionDetail;
+    uint coarseVao, coarseIbo;
+    size_t coarseIndexCount = 0;
+    GenerateIndexedVertexArray(coarseVao, vbo, coarseIbo);
+
+    auto updateCoarseBuffer = [&](Mesh& m)
+    {
+        std::vector<uint32_t> coarseIndices = BuildCoarseIndices(m.vertices, m.indices, m.bounds, motionDetail.settings.coarseResolution);
+        UpdateIndexBuffer(coarseIndices, coarseIbo);
+        coarseIndexCount = coarseIndices.size();
+    };
+
+    // Replays measure full detail, which would otherwise depend on how fast the frames before were
+    if (eventReplayer)
+        motionDetail.settings.isEnabled = false;
+
+    // Live mesh streamed from another process through shared memory, drawn with its own buffers
+    std::unique_ptr<SharedMeshConsumer> liveMesh;
+    uint liveVao, liveVbo, liveIbo;
+    size_t liveVertexCount = 0;
+    size_t liveIndexCount = 0;
+
+    // Frames are copied out of the mapping and checked before anything is uploaded
+    std::vector<Vertex> liveVertices;
+    std::vector<uint32_t> liveIndices;
+    uint32_t liveMaxIndex = 0;
+    uint64_t liveFrame = 0;
+    uint64_t liveSkippedFrames = 0;
+    double liveLatencyMs = 0;
+    if (!options.liveMeshName.empty())
+    {
+        liveMesh = std::make_unique<SharedMeshConsumer>(options.liveMeshName.c_str());
+        if (!liveMesh->IsValid())
+            liveMesh.reset();
+
+        GenerateBuffers(liveVao, liveVbo, liveIbo);
+    }
+
     // Load default mesh
     const char* meshFileName = "teapot";
     std::unique_ptr<Mesh> mesh;
     bool isLoadingMesh = false;
     bool didLoadMesh = false;
+    bool isViewOnly = false;
+    std::unique_ptr<TileStreamer> tileStreamer;
+    std::unique_ptr<MeshSequencePlayer> sequencePlayer;
+    MeshCache meshCache;
+    MeshPreloader meshPreloader(meshCache);
 
     auto loadMesh = [&](std::unique_ptr<Mesh>& m, std::string path)
     {
-        Mesh* loadedMesh = new Mesh(path.c_str());
-        m = std::make_unique<Mesh>(std::move(*loadedMesh));
+        // Recently viewed or preloaded meshes come back from the cache instead of being parsed again
+        auto startTime = std::chrono::steady_clock::now();
+        std::unique_ptr<Mesh> loadedMesh = meshPreloader.TakePromoted(path);
+        MetricsCounter* loadSource = &preloadedMeshLoads;
+        if (!loadedMesh)
+        {
+            loadedMesh = meshPreloader.Take(path);
+            loadSource = &cachedMeshLoads;
+        }
+        if (!loadedMesh)
+        {
+            loadedMesh = std::make_unique<Mesh>(path.c_str());
+            loadSource = &parsedMeshLoads;
+        }
+
+        std::unique_ptr<Mesh> previousMesh = std::exchange(m, std::move(loadedMesh));
         SDL_GL_MakeCurrent(window, loaderContext);
         PopulateBuffers(m->vertices, m->indices, vao, vbo, ibo);
+        updateCoarseBuffer(*m);
         SDL_GL_MakeCurrent(window, context);
+
+        // Keep only metadata on the CPU side when just viewing
+        if (isViewOnly)
+            m->ReleaseCpuData();
+
+        loadSource->Add();
+        meshLoadTimes.Record(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
         didLoadMesh = true;
+        meshCache.Put(std::move(previousMesh));
     };
 
-    std::thread(loadMesh, std::ref(mesh), "./task_input/teapot.json").detach();
+    // Replayed loads finish in the frame that starts them, so every replay draws the same meshes in the same frames
+    if (eventReplayer)
+        loadMesh(mesh, "./task_input/teapot.json");
+    else
+        std::thread(loadMesh, std::ref(mesh), "./task_input/teapot.json").detach();
+
+    // Hot reload, the watched file is parsed again in the background and swapped in once complete
+    std::string meshPath = "./task_input/teapot.json";
+    std::unique_ptr<FileWatcher> meshWatcher = std::make_unique<FileWatcher>(meshPath);
+    std::unique_ptr<Mesh> reloadedMesh;
+    std::string reloadedMeshPath;
+    bool isReloadingMesh = false;
+    bool didReloadMesh = false;
+
+    auto reloadMesh = [&](std::string path)
+    {
+        // Files caught mid-write fail to parse and are skipped, the next change triggers another attempt
+        reloadedMesh = Mesh::TryLoad(path.c_str());
+        reloadedMeshPath = path;
+        didReloadMesh = true;
+    };
 
     // Load shaders
     Shader solidShader("./shaders/shader.vert", "./shaders/shader.frag");
@@ -136,29 +241,72 @@ int main(int argc, char* argv[])
 
     // UI state
     bool isOpenMeshPicker = false;
+    int hoveredMeshIdx = -1;
     std::vector<std::filesystem::path> meshFilePaths;
 
     TriangleStatistics meshStatistics;
+    ApproximateStatistics meshStatisticsEstimate = {};
     bool didCalculateStats = false;
     bool isCalculatingStats = false;
 
     bool isPointInside = false;
     bool didCalculatePoint = false;
 
+    // Set when a view-only mesh could not be reloaded for a CPU operation, the GPU copy stays on screen
+    bool isSourceUnavailable = false;
+
     bool isWireframeRendering = false;
     bool isNormalRendering = false;
 
     bool isCameraMoveOn = false;
+    ImVec2 replayMousePos(-FLT_MAX, -FLT_MAX);
 
+    uint64_t prevAllocationCount = GetAllocationCount();
+    uint64_t prevAllocatedBytes = GetAllocatedBytes();
+
+    auto prevFrameStartTime = std::chrono::steady_clock::now();
     while (true)
     {
+        auto frameStartTime = std::chrono::steady_clock::now();
+        double frameSeconds = std::chrono::duration<double>(frameStartTime - prevFrameStartTime).count();
+        frameTimes.Record(frameSeconds);
+
         Uint32 currentTicks = SDL_GetTicks();
         float deltaTime = float(currentTicks - prevTicks) / 1000;
 
+        prevFrameStartTime = frameStartTime;
+
         // Event handling
         ImGui_ImplSDL2_ProcessEvent(&windowEvent);
 
-        if (SDL_PollEvent(&windowEvent))
+        bool hasEvent = false;
+        if (eventReplayer)
+        {
+            // Live input is ignored while replaying, apart from closing the window
+            SDL_Event liveEvent;
+            bool isQuitRequested = false;
+            while (SDL_PollEvent(&liveEvent))
+                isQuitRequested = isQuitRequested || liveEvent.type == SDL_QUIT;
+
+            RecordedFrame frame;
+            if (isQuitRequested || !eventReplayer->NextFrame(frame))
+                break;
+
+            deltaTime = frame.deltaTime;
+            hasEvent = frame.hasEvent;
+            if (hasEvent)
+                windowEvent = frame.event;
+            if (hasEvent && (windowEvent.type == SDL_MOUSEMOTION || windowEvent.type == SDL_MOUSEBUTTONDOWN || windowEvent.type == SDL_MOUSEBUTTONUP))
+                replayMousePos = windowEvent.type == SDL_MOUSEMOTION ? ImVec2(windowEvent.motion.x, windowEvent.motion.y)
+                                                                     : ImVec2(windowEvent.button.x, windowEvent.button.y);
+        }
+        else
+            hasEvent = SDL_PollEvent(&windowEvent);
+
+        if (eventRecorder)
+            eventRecorder->RecordFrame(deltaTime, hasEvent ? &windowEvent : nullptr);
+
+        if (hasEvent)
         {
             if (windowEvent.type == SDL_QUIT)
                 break;
@@ -166,7 +314,8 @@ int main(int argc, char* argv[])
                 break;
             if (windowEvent.type == SDL_MOUSEWHEEL)
                 cameraPos.z += windowEvent.wheel.y * deltaTime * 10;
-            if (windowEvent.type == SDL_MOUSEBUTTONDOWN)
+            // Drags that start on a window of the UI move the window, not the camera
+            if (windowEvent.type == SDL_MOUSEBUTTONDOWN && !ImGui::GetIO().WantCaptureMouse)
                 isCameraMoveOn = true;
             else if (windowEvent.type == SDL_MOUSEBUTTONUP)
                 isCameraMoveOn = false;
@@ -179,6 +328,8 @@ int main(int argc, char* argv[])
             {
                 width = windowEvent.window.data1;
                 height = windowEvent.window.data2;
+                if (eventReplayer)
+                    SDL_SetWindowSize(window, width, height);
                 proj = glm::perspective(glm::radians(45.0f), (float)width / (float)height, 0.1f, 1000.0f);
                 glViewport(0, 0, width, height);
             }
@@ -187,39 +338,106 @@ int main(int argc, char* argv[])
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplSDL2_NewFrame();
+
+        // The backend reads the real cursor while the window has focus, the recorded one takes precedence
+        if (eventReplayer)
+            ImGui::GetIO().AddMousePosEvent(replayMousePos.x, replayMousePos.y);
         ImGui::NewFrame();
 
+        // The newest live frame is copied out of the mapping and only uploaded when the producer did not overwrite it
+        // meanwhile, a torn frame is dropped and the next published one is taken instead
+        SharedMeshFrame liveMeshFrame;
+        if (liveMesh && liveMesh->AcquireLatest(liveMeshFrame))
+        {
+            liveVertices.assign(liveMeshFrame.vertices, liveMeshFrame.vertices + liveMeshFrame.vertexCount);
+            if (liveMeshFrame.indices)
+                liveIndices.assign(liveMeshFrame.indices, liveMeshFrame.indices + liveMeshFrame.indexCount);
+
+            if (liveMesh->IsFrameIntact(liveMeshFrame))
+            {
+                // The producer is another process, so triangles must not reach past the vertices it sent. Invalid
+                // topology is dropped until the next one and a frame too short for the current topology is skipped
+                if (liveMeshFrame.indices)
+                {
+                    liveMaxIndex = liveIndices.empty() ? 0 : *std::max_element(liveIndices.begin(), liveIndices.end());
+                    if (liveIndices.size() % 3 != 0 || (!liveIndices.empty() && liveMaxIndex >= liveVertices.size()))
+                    {
+                        std::cerr << "Ignoring live mesh topology with indices past its vertices" << std::endl;
+                        liveIndices.clear();
+                        liveMaxIndex = 0;
+                    }
+
+                    glBindVertexArray(liveVao);
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, liveIbo);
+                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, liveIndices.size() * sizeof(uint32_t), liveIndices.data(), GL_STATIC_DRAW);
+                    glBindVertexArray(0);
+                    liveIndexCount = liveIndices.size();
+                }
+
+                if (liveIndexCount == 0 || liveMaxIndex < liveVertices.size())
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, liveVbo);
+                    if (liveVertices.size() == liveVertexCount)
+                        glBufferSubData(GL_ARRAY_BUFFER, 0, liveVertexCount * sizeof(Vertex), liveVertices.data());
+                    else
+                        glBufferData(GL_ARRAY_BUFFER, liveVertices.size() * sizeof(Vertex), liveVertices.data(), GL_STREAM_DRAW);
+                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+                    liveVertexCount = liveVertices.size();
+                }
+
+                liveSkippedFrames += liveFrame > 0 ? liveMeshFrame.frame - liveFrame - 1 : 0;
+                liveFrame = liveMeshFrame.frame;
+                liveLatencyMs = (SharedMeshConsumer::GetTimeNs() - liveMeshFrame.publishTimeNs) / 1e6;
+            }
+        }
+
+        if (sequencePlayer)
+            sequencePlayer->Update(deltaTime);
+
         // Render scene
         glClearColor(0.045f, 0.045f, 0.045f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if (didLoadMesh)
+        // Detail drops while dragging the camera misses the frame time target and comes back once it rests
+        bool hasCoarseMesh = didLoadMesh && !tileStreamer && !liveMesh && !sequencePlayer && coarseIndexCount > 0;
+        MotionDetailLevel motionLevel = motionDetail.Update(isCameraMoveOn, frameSeconds * 1000, isNormalRendering, hasCoarseMesh);
+        bool isCoarseDrawn = hasCoarseMesh && motionLevel == motionDetailCoarse;
+
+        if (didLoadMesh || tileStreamer || liveMesh || sequencePlayer)
         {
             Shader& currentShader = isWireframeRendering ? wireframeShader : solidShader;
             glUseProgram(currentShader.id);
-            glBindVertexArray(vao);
+            glBindVertexArray(liveMesh ? liveVao : (isCoarseDrawn ? coarseVao : vao));
+            size_t drawIndexCount = liveMesh ? liveIndexCount : (isCoarseDrawn ? coarseIndexCount : (didLoadMesh ? mesh->indexCount : 0));
 
             rotation += deltaTime * M_PI * 5;
             model = glm::rotate(glm::mat4(1.0f), glm::radians(rotation), glm::vec3(1.0f, 1.0f, 0.0f)) * baseModel;
             glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
-            currentShader.SetUniform("model", model);
-            currentShader.SetUniform("view", view);
-            currentShader.SetUniform("projection", proj);
-            glm::vec3 lightPos(500.0f, 500.0f, 500.0f);
-            currentShader.SetUniform("lightPos", lightPos);
+            SetSceneUniforms(currentShader, model, view, proj);
 
             glPolygonMode(GL_FRONT_AND_BACK, isWireframeRendering ? GL_LINE : GL_FILL);
-            glDrawElements(GL_TRIANGLES, mesh->indices.size(), GL_UNSIGNED_INT, nullptr);
+            if (tileStreamer)
+            {
+                tileStreamer->Update(model, view, proj, cameraPos);
+                tileStreamer->Draw();
+            }
+            else if (sequencePlayer)
+                sequencePlayer->Draw();
+            else
+                glDrawElements(GL_TRIANGLES, drawIndexCount, GL_UNSIGNED_INT, nullptr);
 
-            if (isNormalRendering)
+            if (isNormalRendering && motionLevel == motionDetailFull)
             {
                 glUseProgram(normalsShader.id);
 
-                normalsShader.SetUniform("model", model);
-                normalsShader.SetUniform("view", view);
-                normalsShader.SetUniform("projection", proj);
-                glDrawElements(GL_TRIANGLES, mesh->indices.size(), GL_UNSIGNED_INT, nullptr);
+                SetSceneUniforms(normalsShader, model, view, proj);
+                if (tileStreamer)
+                    tileStreamer->Draw();
+                else if (sequencePlayer)
+                    sequencePlayer->Draw();
+                else
+                    glDrawElements(GL_TRIANGLES, drawIndexCount, GL_UNSIGNED_INT, nullptr);
             }
 
             glBindVertexArray(0);
@@ -234,11 +452,14 @@ int main(int argc, char* argv[])
         {
             ImGui::OpenPopup("mesh_selection");
             isOpenMeshPicker = true;
+            hoveredMeshIdx = -1;
             meshFilePaths.clear();
             std::string path = "./task_input";
             for (const auto& entry : std::filesystem::directory_iterator(path))
             {
-                if (entry.path().extension().compare(".json") == 0)
+                const auto extension = entry.path().extension();
+                if (extension.compare(".json") == 0 || extension.compare(".gz") == 0 || extension.compare(".zst") == 0 || extension.compare(".glb") == 0 || extension.compare(".obj") == 0
+                    || extension.compare(".tiles") == 0 || extension.compare(".seq") == 0)
                     meshFilePaths.push_back(entry.path());
             }
         }
@@ -252,24 +473,86 @@ int main(int argc, char* argv[])
             for (int i = 0; i < meshFilePaths.size(); i++)
             {
                 const auto path = meshFilePaths[i];
-                if (ImGui::Selectable(path.filename().c_str(), false))
+                bool isPicked = ImGui::Selectable(path.filename().c_str(), false);
+
+                // A tiled mesh that fails to open leaves the current mesh on screen
+                std::unique_ptr<TileStreamer> pickedTileStreamer;
+                if (isPicked && path.extension().compare(".tiles") == 0)
                 {
-                    // Load new mesh
-                    didLoadMesh = false;
-                    isLoadingMesh = true;
-                    std::thread(loadMesh, std::ref(mesh), path.string()).detach();
+                    pickedTileStreamer = std::make_unique<TileStreamer>(path.c_str());
+                    isPicked = pickedTileStreamer->IsValid();
+                }
 
-                    // Update state
-                    isOpenMeshPicker = false;
+                if (isPicked)
+                {
+                    if (pickedTileStreamer)
+                    {
+                        // Tiled meshes are streamed by the render thread instead of loaded up front
+                        tileStreamer = std::move(pickedTileStreamer);
+                        sequencePlayer.reset();
+                        meshWatcher.reset();
+                    }
+                    else if (path.extension().compare(".seq") == 0)
+                    {
+                        // Sequences keep their topology on the GPU and stream positions per frame
+                        sequencePlayer = std::make_unique<MeshSequencePlayer>(path.c_str());
+                        tileStreamer.reset();
+                        meshWatcher.reset();
+                    }
+                    else
+                    {
+                        // Load new mesh, taking over a preload of it that is still running
+                        meshPreloader.Promote(path.string());
+                        tileStreamer.reset();
+                        sequencePlayer.reset();
+                        didLoadMesh = false;
+                        isLoadingMesh = true;
+                        if (eventReplayer)
+                            loadMesh(mesh, path.string());
+                        else
+                            std::thread(loadMesh, std::ref(mesh), path.string()).detach();
+
+                        meshPath = path.string();
+                        meshWatcher = std::make_unique<FileWatcher>(path);
+                    }
+
+                    // Update state, closing the picker cancels the remaining preloads
+                    liveMesh.reset();
                     didCalculateStats = false;
                     didCalculatePoint = false;
+                    isSourceUnavailable = false;
                     meshFileName = path.stem().c_str();
                 }
+
+                // Preload the hovered mesh and its neighbors in the list while the user decides
+                if (ImGui::IsItemHovered() && hoveredMeshIdx != i)
+                {
+                    hoveredMeshIdx = i;
+                    std::vector<std::string> preloadPaths;
+                    std::vector<int> preloadIdxs = { i };
+                    for (int offset = 1; offset <= meshPreloader.settings.neighborCount; offset++)
+                        preloadIdxs.insert(preloadIdxs.end(), { i + offset, i - offset });
+
+                    for (int j : preloadIdxs)
+                    {
+                        if (j >= 0 && j < meshFilePaths.size() && meshFilePaths[j].extension().compare(".tiles") != 0
+                            && meshFilePaths[j].extension().compare(".seq") != 0 && meshFilePaths[j] != meshPath)
+                            preloadPaths.push_back(meshFilePaths[j].string());
+                    }
+
+                    meshPreloader.Request(preloadPaths);
+                }
             }
 
             ImGui::EndPopup();
         }
 
+        if (!ImGui::IsPopupOpen("mesh_selection") && isOpenMeshPicker)
+        {
+            isOpenMeshPicker = false;
+            meshPreloader.Cancel();
+        }
+
         // Mesh loading indicator
         if (isLoadingMesh)
         {
@@ -280,22 +563,85 @@ int main(int argc, char* argv[])
                 isLoadingMesh = false;
         }
 
+        // Mesh hot reload
+        // File changes are not part of a recording
+        if (meshWatcher && !eventReplayer && meshWatcher->PollChanged() && didLoadMesh && !isReloadingMesh)
+        {
+            isReloadingMesh = true;
+            didReloadMesh = false;
+            std::thread(reloadMesh, meshPath).detach();
+        }
+
+        if (didReloadMesh && !isCalculatingStats)
+        {
+            // Results for a mesh that was replaced from the picker meanwhile are dropped
+            if (reloadedMesh && didLoadMesh && !tileStreamer && !sequencePlayer && reloadedMeshPath == meshPath)
+            {
+                // Same topology means the index buffer is still valid and only vertex data needs uploading
+                if (reloadedMesh->vertexCount == mesh->vertexCount && reloadedMesh->indexCount == mesh->indexCount
+                    && reloadedMesh->topologyHash == mesh->topologyHash)
+                    UpdateVertexBuffer(reloadedMesh->vertices, vbo);
+                else
+                    PopulateBuffers(reloadedMesh->vertices, reloadedMesh->indices, vao, vbo, ibo);
+
+                // The clustering depends on the positions, so moved vertices need new coarse triangles as well
+                updateCoarseBuffer(*reloadedMesh);
+
+                mesh = std::move(reloadedMesh);
+                if (isViewOnly)
+                    mesh->ReleaseCpuData();
+
+                didCalculateStats = false;
+                didCalculatePoint = false;
+                isSourceUnavailable = false;
+            }
+
+            reloadedMesh.reset();
+            didReloadMesh = false;
+            isReloadingMesh = false;
+        }
+
         // Utility
         if (ImGui::Button("Reset Camera"))
             cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
 
+        if (sequencePlayer)
+            ImGui::Checkbox("Play sequence", &sequencePlayer->isPlaying);
+
         if (ImGui::Button(isWireframeRendering ? "Smooth shading" : "Wireframe"))
             isWireframeRendering = !isWireframeRendering;
 
         if (ImGui::Button(isNormalRendering ? "Hide Normals" : "Show Normals"))
             isNormalRendering = !isNormalRendering;
 
+        ImGui::Checkbox("Adaptive detail while moving", &motionDetail.settings.isEnabled);
+        ImGui::SliderFloat("Target frame ms", &motionDetail.settings.targetFrameMs, 4.0f, 50.0f, "%.1f");
+
+        // CPU mesh operations are not available for streamed tiles
+        ImGui::BeginDisabled(tileStreamer != nullptr || liveMesh != nullptr || sequencePlayer != nullptr);
+
+        if (ImGui::Checkbox("View-only", &isViewOnly) && isViewOnly && didLoadMesh && !isCalculatingStats)
+            mesh->ReleaseCpuData();
+
         // Triangle statistics
         if (ImGui::Button("Calculate Statistics") && !isCalculatingStats)
         {
-            isCalculatingStats = true;
-            didCalculateStats = false;
-            mesh->CalculateStatistics(meshStatistics, didCalculateStats);
+            // Loads and subdivisions keep the statistics with the metadata, so a view-only mesh is not parsed again
+            if (mesh->HasStatistics())
+            {
+                meshStatistics = mesh->CalculateStatistics();
+                didCalculateStats = true;
+            }
+            else
+            {
+                // Show a sampled estimate right away while the exact pass runs
+                isCalculatingStats = true;
+                didCalculateStats = false;
+                auto startTime = std::chrono::steady_clock::now();
+                meshStatisticsEstimate = mesh->EstimateStatistics();
+                estimateQueryTimes.Record(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+                mesh->CalculateStatistics(meshStatistics, didCalculateStats);
+            }
         }
 
         // Calculation loading indicator
@@ -308,26 +654,52 @@ int main(int argc, char* argv[])
         if (didCalculateStats)
         {
             isCalculatingStats = false;
-            ImGui::Text("Triangle Area Statistics:\nMax: %f\nMin: %f\nAvg: %f", meshStatistics.maxArea, meshStatistics.minArea, meshStatistics.avgArea);
+            ImGui::Text("Triangle Area Statistics:\nMax: %f\nMin: %f\nAvg: %f\nP10: %f\nMedian: %f\nP90: %f", meshStatistics.maxArea,
+                meshStatistics.minArea, meshStatistics.avgArea, meshStatistics.quantileAreas[0], meshStatistics.quantileAreas[1],
+                meshStatistics.quantileAreas[2]);
+        }
+        else if (isCalculatingStats)
+        {
+            const ApproximateStatistics& estimate = meshStatisticsEstimate;
+            ImGui::Text("Triangle Area Statistics (%zu samples):\nAvg: %f +/- %f\nP10: %f (%f - %f)\nMedian: %f (%f - %f)\nP90: %f (%f - %f)",
+                estimate.sampleCount, estimate.avgArea, estimate.avgAreaMargin, estimate.quantileAreas[0], estimate.quantileLowAreas[0],
+                estimate.quantileHighAreas[0], estimate.quantileAreas[1], estimate.quantileLowAreas[1], estimate.quantileHighAreas[1],
+                estimate.quantileAreas[2], estimate.quantileLowAreas[2], estimate.quantileHighAreas[2]);
         }
         else
         {
-            ImGui::TextUnformatted("Triangle Area Statistics:\nMax: -\nMin: -\nAvg: -");
+            ImGui::TextUnformatted("Triangle Area Statistics:\nMax: -\nMin: -\nAvg: -\nP10: -\nMedian: -\nP90: -");
         }
 
         // Subdivision
         if (ImGui::Button("Subdivide"))
         {
-            mesh->Subdivide();
-            PopulateBuffers(mesh->vertices, mesh->indices, vao, vbo, ibo);
+            if (mesh->EnsureResident())
+            {
+                mesh->Subdivide();
+                PopulateBuffers(mesh->vertices, mesh->indices, vao, vbo, ibo);
+                updateCoarseBuffer(*mesh);
+
+                if (isViewOnly && !isCalculatingStats)
+                    mesh->ReleaseCpuData();
+            }
+            else
+                isSourceUnavailable = true;
         }
 
         // Point test
         static float point[3] = { 0.10f, 0.20f, 0.30f };
         if (ImGui::Button("Test Point Local"))
         {
-            isPointInside = mesh->IsPointInside(glm::vec3(point[0], point[1], point[2]));
-            didCalculatePoint = true;
+            if (mesh->EnsureResident())
+            {
+                auto startTime = std::chrono::steady_clock::now();
+                isPointInside = mesh->IsPointInside(glm::vec3(point[0], point[1], point[2]));
+                pointQueryTimes.Record(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+                didCalculatePoint = true;
+            }
+            else
+                isSourceUnavailable = true;
         }
 
         ImGui::SameLine();
@@ -336,6 +708,11 @@ int main(int argc, char* argv[])
         ImGui::TextUnformatted(pointResIndicator.c_str());
         ImGui::InputFloat3("", point);
 
+        if (isSourceUnavailable)
+            ImGui::TextUnformatted("Mesh file is gone, CPU operations are unavailable");
+
+        ImGui::EndDisabled();
+
         ImGui::End();
 
         // Stats
@@ -348,20 +725,77 @@ int main(int argc, char* argv[])
         flags |= ImGuiWindowFlags_NoResize;
         ImGui::Begin("Stats", nullptr, flags);
 
-        std::string vertexCountText = std::to_string(mesh->vertices.size()) + " vertices";
-        float vertexCountTextW = ImGui::CalcTextSize(vertexCountText.c_str()).x;
-        std::string triangleCountText = std::to_string(mesh->indices.size() / 3) + " triangles";
-        float triangleCountTextW = ImGui::CalcTextSize(triangleCountText.c_str()).x;
-        std::string indexCountText = std::to_string(mesh->indices.size()) + " indices";
-        float indexCountTextW = ImGui::CalcTextSize(indexCountText.c_str()).x;
+        AllocationScope overlayAllocationScope("Stats overlay");
+        std::vector<std::string> statsLines;
+        if (liveMesh)
+        {
+            char latencyLine[64];
+            snprintf(latencyLine, sizeof(latencyLine), "%.2f ms latency", liveLatencyMs);
+            statsLines.push_back("Live frame " + std::to_string(liveFrame));
+            statsLines.push_back(latencyLine);
+            statsLines.push_back(std::to_string(liveSkippedFrames) + " frames skipped");
+            statsLines.push_back(std::to_string(liveVertexCount) + " vertices");
+            statsLines.push_back(std::to_string(liveIndexCount / 3) + " triangles");
+        }
+        else if (sequencePlayer)
+        {
+            statsLines.push_back("Frame " + std::to_string(sequencePlayer->GetCurrentFrame() + 1) + "/" + std::to_string(sequencePlayer->GetFrameCount()));
+            statsLines.push_back(std::to_string(sequencePlayer->droppedFrameCount) + " frames dropped");
+            statsLines.push_back(std::to_string(sequencePlayer->GetHeader().vertexCount) + " vertices");
+            statsLines.push_back(std::to_string(sequencePlayer->GetHeader().indexCount / 3) + " triangles");
+        }
+        else if (tileStreamer)
+        {
+            statsLines.push_back(std::to_string(tileStreamer->residentTileCount) + "/" + std::to_string(tileStreamer->GetTileCount()) + " tiles resident");
+            statsLines.push_back(std::to_string(tileStreamer->visibleTileCount) + " tiles visible");
+            statsLines.push_back(std::to_string(tileStreamer->vramUsage / (1024 * 1024)) + " MB VRAM");
+        }
+        else
+        {
+            statsLines.push_back(std::to_string(mesh->vertexCount) + " vertices");
+            statsLines.push_back(std::to_string(mesh->indexCount / 3) + " triangles");
+            statsLines.push_back(std::to_string(mesh->indexCount) + " indices");
+        }
+
+        if (motionLevel != motionDetailFull)
+            statsLines.push_back(motionLevel == motionDetailCoarse ? "Coarse while moving" : "Normals hidden while moving");
+
+        MeshCacheStats cacheStats = meshCache.GetStats();
+        if (cacheStats.rawCount + cacheStats.compressedCount > 0)
+        {
+            char cacheLine[128];
+            snprintf(cacheLine, sizeof(cacheLine), "Cache: %zu raw, %zu compressed (%.1fx, restore %.1f ms)", cacheStats.rawCount,
+                cacheStats.compressedCount, cacheStats.GetCompressionRatio(), cacheStats.lastRestoreMs);
+            statsLines.push_back(cacheLine);
+        }
+
+        if (isAllocationTrackingEnabled)
+        {
+            // Everything allocated by any thread since the previous frame's overlay
+            uint64_t allocationCount = GetAllocationCount();
+            uint64_t allocatedBytes = GetAllocatedBytes();
+            char allocationLine[128];
+            snprintf(allocationLine, sizeof(allocationLine), "%llu allocations per frame (%.1f KB)",
+                (unsigned long long)(allocationCount - prevAllocationCount), (allocatedBytes - prevAllocatedBytes) / 1024.0);
+            statsLines.push_back(allocationLine);
+            prevAllocationCount = allocationCount;
+            prevAllocatedBytes = allocatedBytes;
+
+            for (const AllocationScopeStats& scopeStats : GetAllocationScopeStats())
+            {
+                snprintf(allocationLine, sizeof(allocationLine), "%s: %llu, %.1f MB, peak %.1f MB", scopeStats.name,
+                    (unsigned long long)scopeStats.count, scopeStats.bytes / (1024.0 * 1024.0), scopeStats.peakBytes / (1024.0 * 1024.0));
+                statsLines.push_back(allocationLine);
+            }
+        }
 
         ImGui::GetStyle().Colors[ImGuiCol_Text] = ImVec4(1.0f, 0.7f, 0.2f, 1.0f);
-        ImGui::SetCursorPosX(ImGui::GetWindowWidth() - vertexCountTextW - ImGui::GetStyle().ItemSpacing.x);
-        ImGui::TextUnformatted(vertexCountText.c_str());
-        ImGui::SetCursorPosX(ImGui::GetWindowWidth() - triangleCountTextW - ImGui::GetStyle().ItemSpacing.x);
-        ImGui::TextUnformatted(triangleCountText.c_str());
-        ImGui::SetCursorPosX(ImGui::GetWindowWidth() - indexCountTextW - ImGui::GetStyle().ItemSpacing.x);
-        ImGui::TextUnformatted(indexCountText.c_str());
+        for (const std::string& line : statsLines)
+        {
+            float lineW = ImGui::CalcTextSize(line.c_str()).x;
+            ImGui::SetCursorPosX(ImGui::GetWindowWidth() - lineW - ImGui::GetStyle().ItemSpacing.x);
+            ImGui::TextUnformatted(line.c_str());
+        }
 
         ImGui::End();
 
@@ -370,6 +804,10 @@ int main(int argc, char* argv[])
 
         SDL_GL_SwapWindow(window);
 
+        // Without vsync the swap returns once the driver queued the frame, so this covers the whole frame
+        if (eventReplayer)
+            eventReplayer->AddFrameTime(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStartTime).count());
+
         prevTicks = currentTicks;
     }
 
@@ -380,5 +818,12 @@ int main(int argc, char* argv[])
     SDL_GL_DeleteContext(loaderContext);
     SDL_DestroyWindow(window);
     SDL_Quit();
-    return 0;
+
+    int viewerExitCode = 0;
+    if (eventReplayer)
+        viewerExitCode = eventReplayer->WriteReport(options.replayReportPath.c_str()) ? 0 : 1;
+
+    PrintAllocationReport();
+    StopMetricsServer();
+    return viewerExitCode;
 }
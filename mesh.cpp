@@ -1,13 +1,19 @@
+#include <filesystem>
 #include <future>
 #include <iostream>
 #include <numeric>
+#include <random>
+#include <string_view>
 #include <thread>
 #include <map>
 
 #include "rapidjson/document.h"
-#include "rapidjson/filereadstream.h"
 
+#include "allocation_tracker.h"
+#include "gltf.h"
 #include "mesh.h"
+#include "obj.h"
+#include "pipelined_stream.h"
 
 Vertex::Vertex(glm::vec3 position, glm::vec3 normal)
     : position(position), normal(normal)
@@ -15,45 +21,145 @@ Vertex::Vertex(glm::vec3 position, glm::vec3 normal)
 }
 
 TriangleStatistics::TriangleStatistics()
-    : minArea(FLT_MAX), maxArea(0), avgArea(0)
+    : minArea(FLT_MAX), maxArea(0), avgArea(0), quantileAreas()
+{
+}
+
+Bounds::Bounds()
+    : min(FLT_MAX), max(-FLT_MAX)
+{
+}
+
+void Bounds::Extend(glm::vec3 p)
+{
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+}
+
+Mesh::Mesh()
+    : vertexCount(0), indexCount(0), topologyHash(0), subdivisionLevel(0), isResident(false), hasStatistics(false), areNormalsDeferred(false)
 {
 }
 
 Mesh::Mesh(const char* path)
+    : Mesh()
 {
-    FILE* file = fopen(path, "rb");
-    if (!file)
-    {
-        std::cerr << "Failed to open file" << std::endl;
+    this->path = path;
+    if (!Load())
         exit(1);
+}
+
+std::unique_ptr<Mesh> Mesh::TryLoad(const char* path, const std::atomic<bool>* isCancelled, bool shouldDeferNormals)
+{
+    std::unique_ptr<Mesh> mesh(new Mesh());
+    mesh->path = path;
+    if (!mesh->Load(isCancelled, shouldDeferNormals))
+        return nullptr;
+
+    return mesh;
+}
+
+bool Mesh::Load(const std::atomic<bool>* isCancelled, bool shouldDeferNormals)
+{
+    AllocationScope allocationScope("Load");
+    bool hasNormals = false;
+    bool hasBounds = false;
+    const std::filesystem::path extension = std::filesystem::path(path).extension();
+    if (extension == ".glb")
+    {
+        if (!ReadGlb(path.c_str(), vertices, indices, hasNormals))
+            return false;
     }
+    else if (extension == ".obj")
+    {
+        if (!ReadObj(path.c_str(), vertices, indices, hasNormals))
+            return false;
+    }
+    else if (!LoadJson(hasNormals, hasBounds, isCancelled, shouldDeferNormals))
+        return false;
+
+    if (isCancelled && *isCancelled)
+        return false;
 
-    // Parse json file
-    char buffer[65536];
-    rapidjson::FileReadStream inputStream(file, buffer, sizeof(buffer));
+    // JSON folds them into its pass over the triangles unless deferred
+    areNormalsDeferred = shouldDeferNormals && !hasNormals;
+    if (!shouldDeferNormals && !hasStatistics)
+        CalculateNormalsAndStatistics(!hasNormals);
 
+    UpdateMetadata(!hasBounds);
+    isResident = true;
+    return true;
+}
+
+static bool ReadVec3(const rapidjson::Value& value, glm::vec3& v)
+{
+    if (!value.IsArray() || value.Size() != 3 || !value[0].IsNumber() || !value[1].IsNumber() || !value[2].IsNumber())
+        return false;
+
+    v = glm::vec3(value[0].GetFloat(), value[1].GetFloat(), value[2].GetFloat());
+    return true;
+}
+
+static void AddTriangleArea(TriangleStatistics& stats, float area, int triangleCount)
+{
+    if (stats.minArea > area && area != 0)
+        stats.minArea = area;
+    if (stats.maxArea < area)
+        stats.maxArea = area;
+    stats.avgArea += area / triangleCount;
+}
+
+// Each selection leaves larger areas after it, so the next quantile only searches the rest
+static void SelectAreaQuantiles(std::vector<float>& areas, TriangleStatistics& stats)
+{
+    auto begin = areas.begin();
+    for (int i = 0; i < areaQuantileCount && !areas.empty(); i++)
+    {
+        auto nth = areas.begin() + size_t(areaQuantiles[i] * (areas.size() - 1));
+        std::nth_element(begin, nth, areas.end());
+        stats.quantileAreas[i] = *nth;
+        begin = nth;
+    }
+}
+
+bool Mesh::LoadJson(bool& hasNormals, bool& hasBounds, const std::atomic<bool>* isCancelled, bool shouldDeferNormals)
+{
     rapidjson::Document doc;
-    doc.ParseStream(inputStream);
 
-    fclose(file);
+    if (IsGzipFile(path.c_str()))
+    {
+        // Decompression runs on its own thread feeding the parser
+        if (!ParseGzipJson(path.c_str(), doc, isCancelled))
+            return false;
+    }
+    else if (IsZstdFile(path.c_str()))
+    {
+        if (!ParseZstdJson(path.c_str(), doc, isCancelled))
+            return false;
+    }
+    else if (!ParseFileJson(path.c_str(), doc, isCancelled))
+        return false;
+
+    if (isCancelled && *isCancelled)
+        return false;
 
     if (doc.HasParseError())
     {
         std::cerr << "Failed to parse JSON" << std::endl;
-        exit(1);
+        return false;
     }
 
     if (!doc.IsObject() || !doc.HasMember("geometry_object"))
     {
         std::cerr << "Invalid JSON format" << std::endl;
-        exit(1);
+        return false;
     }
 
     const rapidjson::Value& vertexObject = doc["geometry_object"];
     if (!vertexObject.IsObject() || !vertexObject.HasMember("vertices") || !vertexObject.HasMember("triangles"))
     {
         std::cerr << "Invalid vertex object format" << std::endl;
-        exit(1);
+        return false;
     }
 
     const rapidjson::Value& verticesArray = vertexObject["vertices"];
@@ -62,16 +168,35 @@ Mesh::Mesh(const char* path)
     if (!verticesArray.IsArray() || !trianglesArray.IsArray())
     {
         std::cerr << "Invalid vertices or triangles array format" << std::endl;
-        exit(1);
+        return false;
     }
 
+    // Bounds supplied by the exporter are used as is, otherwise they are extended while parsing vertices
+    if (vertexObject.HasMember("bounds"))
+    {
+        const rapidjson::Value& boundsObject = vertexObject["bounds"];
+        hasBounds = boundsObject.IsObject() && boundsObject.HasMember("min") && boundsObject.HasMember("max")
+            && ReadVec3(boundsObject["min"], bounds.min) && ReadVec3(boundsObject["max"], bounds.max)
+            && glm::all(glm::lessThanEqual(bounds.min, bounds.max));
+
+        if (!hasBounds)
+            std::cerr << "Ignoring invalid bounds, recalculating" << std::endl;
+    }
+
+    if (verticesArray.Size() % 3 != 0)
+    {
+        std::cerr << "Invalid vertices array format" << std::endl;
+        return false;
+    }
+
+    Bounds parsedBounds;
     vertices.reserve(verticesArray.Size() / 3);
-    for (rapidjson::SizeType i = 0; i <= verticesArray.Size() - 3; i += 3)
+    for (rapidjson::SizeType i = 0; i < verticesArray.Size(); i += 3)
     {
-        if (!verticesArray[i].IsNumber())
+        if (!verticesArray[i].IsNumber() || !verticesArray[i + 1].IsNumber() || !verticesArray[i + 2].IsNumber())
         {
             std::cerr << "Invalid vertex format" << std::endl;
-            exit(1);
+            return false;
         }
 
         float x = verticesArray[i].GetFloat();
@@ -79,43 +204,232 @@ Mesh::Mesh(const char* path)
         float z = verticesArray[i + 2].GetFloat();
 
         vertices.emplace_back(glm::vec3(x, y, z), glm::vec3(0.0f));
+        parsedBounds.Extend(vertices.back().position);
     }
 
+    if (!hasBounds)
+    {
+        bounds = parsedBounds;
+        hasBounds = true;
+    }
+
+    // Exporters can provide authoritative normals, used as is when they match the vertices
+    if (vertexObject.HasMember("normals"))
+    {
+        const rapidjson::Value& normalsArray = vertexObject["normals"];
+        hasNormals = normalsArray.IsArray() && normalsArray.Size() == vertices.size() * 3;
+        for (rapidjson::SizeType i = 0; hasNormals && i < normalsArray.Size(); i += 3)
+        {
+            if (!normalsArray[i].IsNumber() || !normalsArray[i + 1].IsNumber() || !normalsArray[i + 2].IsNumber())
+            {
+                hasNormals = false;
+                break;
+            }
+
+            vertices[i / 3].normal = glm::vec3(normalsArray[i].GetFloat(), normalsArray[i + 1].GetFloat(), normalsArray[i + 2].GetFloat());
+        }
+
+        if (!hasNormals)
+        {
+            std::cerr << "Ignoring invalid normals, recalculating" << std::endl;
+            for (Vertex& vertex : vertices)
+                vertex.normal = glm::vec3(0.0f);
+        }
+    }
+
+    if (trianglesArray.Size() % 3 != 0)
+    {
+        std::cerr << "Invalid triangles array format" << std::endl;
+        return false;
+    }
+
+    // The document is walked once after parsing, each triangle feeds the normals and the statistics as its indices are copied
+    int triangleCount = trianglesArray.Size() / 3;
+    std::vector<float> areas(shouldDeferNormals ? 0 : triangleCount);
+    statistics = TriangleStatistics();
+
     indices.reserve(trianglesArray.Size());
     for (rapidjson::SizeType i = 0; i < trianglesArray.Size(); i++)
     {
-        if (!trianglesArray[i].IsInt())
+        if (!trianglesArray[i].IsInt() || trianglesArray[i].GetInt() < 0 || trianglesArray[i].GetInt() >= int(vertices.size()))
         {
             std::cerr << "Invalid index format" << std::endl;
-            exit(1);
+            return false;
         }
 
         indices.emplace_back(trianglesArray[i].GetInt());
+        if (i % 3 == 2 && !shouldDeferNormals)
+            AccumulateTriangle(i - 2, !hasNormals, areas.data(), triangleCount);
     }
 
-    CalculateNormals();
+    if (shouldDeferNormals)
+        return true;
+
+    SelectAreaQuantiles(areas, statistics);
+    hasStatistics = true;
+    return true;
 }
 
-void Mesh::CalculateNormals()
+void Mesh::UpdateMetadata(bool shouldCalculateBounds)
 {
-    // Calculate smooth vertex normals (non-normalized)
-    for (int i = 0; i < indices.size(); i += 3)
+    vertexCount = vertices.size();
+    indexCount = indices.size();
+    topologyHash = std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(int)));
+
+    if (!shouldCalculateBounds)
+        return;
+
+    bounds = Bounds();
+    for (const Vertex& vertex : vertices)
+        bounds.Extend(vertex.position);
+}
+
+void Mesh::ReleaseCpuData()
+{
+    // Swap with empty arrays so the memory is actually returned
+    VertexArray().swap(vertices);
+    IndexArray().swap(indices);
+    isResident = false;
+}
+
+void Mesh::RestoreCpuData(VertexArray&& vertices, IndexArray&& indices)
+{
+    this->vertices = std::move(vertices);
+    this->indices = std::move(indices);
+    isResident = true;
+}
+
+bool Mesh::EnsureResident()
+{
+    if (isResident)
+        return true;
+
+    // Loaded separately so a file that was moved, deleted or broken meanwhile leaves the metadata of the GPU copy intact
+    std::unique_ptr<Mesh> loadedMesh = TryLoad(path.c_str());
+    if (!loadedMesh)
     {
-        const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
-        const glm::vec3 normal = triangle.GetNormal();
+        std::cerr << "Failed to reload " << path << ", CPU mesh operations are unavailable" << std::endl;
+        return false;
+    }
 
+    vertices = std::move(loadedMesh->vertices);
+    indices = std::move(loadedMesh->indices);
+    bounds = loadedMesh->bounds;
+    statistics = loadedMesh->statistics;
+    hasStatistics = loadedMesh->hasStatistics;
+    areNormalsDeferred = false;
+    UpdateMetadata(false);
+    isResident = true;
+
+    // Replay subdivisions applied before the data was released
+    int level = subdivisionLevel;
+    subdivisionLevel = 0;
+    for (int i = 0; i < level; i++)
+        Subdivide();
+
+    return true;
+}
+
+void Mesh::AccumulateTriangle(size_t i, bool shouldAccumulateNormals, float* areas, int triangleCount)
+{
+    // Smooth vertex normals (non-normalized)
+    const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
+    const glm::vec3 normal = triangle.GetNormal();
+
+    if (shouldAccumulateNormals)
+    {
         triangle.vA->normal += normal;
         triangle.vB->normal += normal;
         triangle.vC->normal += normal;
     }
+
+    const float area = glm::length(normal) * 0.5;
+    AddTriangleArea(statistics, area, triangleCount);
+    areas[i / 3] = area;
+}
+
+void Mesh::CalculateNormalsAndStatistics(bool shouldCalculateNormals)
+{
+    int triangleCount = indices.size() / 3;
+    std::vector<float> areas(triangleCount);
+    statistics = TriangleStatistics();
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        AccumulateTriangle(i, shouldCalculateNormals, areas.data(), triangleCount);
+
+    SelectAreaQuantiles(areas, statistics);
+    hasStatistics = true;
+}
+
+void Mesh::CalculateDeferredNormals()
+{
+    if (hasStatistics || !isResident)
+        return;
+
+    CalculateNormalsAndStatistics(areNormalsDeferred);
+    areNormalsDeferred = false;
+}
+
+void Mesh::RecalculateNormals()
+{
+    if (!EnsureResident())
+        return;
+
+    for (Vertex& vertex : vertices)
+        vertex.normal = glm::vec3(0);
+
+    CalculateNormalsAndStatistics();
+}
+
+TriangleStatistics Mesh::CalculateRangeStatistics(
+    VertexArray& vertices, const IndexArray& indices, int start, int end, int triangleCount, float* areas)
+{
+    TriangleStatistics stats;
+
+    for (int i = start; i < end; i += 3)
+    {
+        const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
+        const float area = glm::length(triangle.GetNormal()) * 0.5;
+        AddTriangleArea(stats, area, triangleCount);
+
+        if (areas)
+            areas[i / 3] = area;
+    }
+
+    return stats;
+}
+
+TriangleStatistics Mesh::CalculateStatistics()
+{
+    if (hasStatistics)
+        return statistics;
+
+    if (!EnsureResident())
+        return TriangleStatistics();
+
+    CalculateNormalsAndStatistics(false);
+    return statistics;
 }
 
 void Mesh::CalculateStatistics(TriangleStatistics& stats, bool& didCalculate)
 {
+    if (hasStatistics)
+    {
+        stats = statistics;
+        didCalculate = true;
+        return;
+    }
+
+    if (!EnsureResident())
+        return;
+
     // Calculate triangle statistics using all available threads
     int triangleCount = indices.size() / 3;
     uint threadCount = std::thread::hardware_concurrency() > triangleCount ? triangleCount : std::thread::hardware_concurrency();
 
+    // Areas are kept for the exact quantiles
+    auto areas = std::make_shared<std::vector<float>>(triangleCount);
+
     std::vector<std::future<TriangleStatistics>> triangleStatsFutures;
     int start = 0;
     for (int i = 0; i < threadCount; i++)
@@ -123,33 +437,14 @@ void Mesh::CalculateStatistics(TriangleStatistics& stats, bool& didCalculate)
         // Calculate the number of triangles for the current workload
         int batchSize = (i * triangleCount + triangleCount) / threadCount - (i * triangleCount) / threadCount;
 
-        triangleStatsFutures.emplace_back(std::async(
-            std::launch::async,
-            [triangleCount](std::vector<int>& indices, std::vector<Vertex>& vertices, int start, int end)
-            {
-                TriangleStatistics stats;
-
-                for (int i = start; i < end; i += 3)
-                {
-                    const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
-                    const float area = glm::length(triangle.GetNormal()) * 0.5;
-
-                    if (stats.minArea > area && area != 0)
-                        stats.minArea = area;
-                    if (stats.maxArea < area)
-                        stats.maxArea = area;
-                    stats.avgArea += area / triangleCount;
-                }
-
-                return stats;
-            },
-            std::ref(indices), std::ref(vertices), start * 3, (start + batchSize) * 3));
+        triangleStatsFutures.emplace_back(std::async(std::launch::async, CalculateRangeStatistics, std::ref(vertices), std::cref(indices), start * 3,
+            (start + batchSize) * 3, triangleCount, areas->data()));
 
         start += batchSize;
     }
 
     std::thread(
-        [](std::vector<std::future<TriangleStatistics>> statsFutures, TriangleStatistics& stats, bool& didCalculate)
+        [areas](std::vector<std::future<TriangleStatistics>> statsFutures, TriangleStatistics& stats, bool& didCalculate)
         {
             // Accumulate statistics from all threads
             stats = std::accumulate(
@@ -162,28 +457,116 @@ void Mesh::CalculateStatistics(TriangleStatistics& stats, bool& didCalculate)
                     result.maxArea = result.maxArea < currentStats.maxArea ? currentStats.maxArea : result.maxArea;
                     return result;
                 });
+
+            SelectAreaQuantiles(*areas, stats);
             didCalculate = true;
         },
         std::move(triangleStatsFutures), std::ref(stats), std::ref(didCalculate))
         .detach();
 }
 
-size_t HashCombine(size_t v1, size_t v2)
+ApproximateStatistics Mesh::EstimateStatistics(size_t sampleCount)
 {
-    size_t m = std::max(v1, v2);
-    return m * (m + 1) + std::min(v1, v2);
+    if (!EnsureResident())
+        return ApproximateStatistics();
+
+    // Small meshes are measured completely
+    size_t triangleCount = indices.size() / 3;
+    bool isExhaustive = sampleCount >= triangleCount;
+    sampleCount = std::min(sampleCount, triangleCount);
+
+    std::mt19937 random(std::random_device{}());
+    std::uniform_int_distribution<size_t> triangleDistribution(0, triangleCount > 0 ? triangleCount - 1 : 0);
+
+    std::vector<float> areas(sampleCount);
+    double sum = 0;
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        size_t triangleIdx = isExhaustive ? i : triangleDistribution(random);
+        const Triangle triangle = Triangle::GetTriangle(vertices, indices, triangleIdx * 3);
+        areas[i] = glm::length(triangle.GetNormal()) * 0.5;
+        sum += areas[i];
+    }
+
+    ApproximateStatistics estimate = {};
+    estimate.sampleCount = sampleCount;
+    if (sampleCount == 0)
+        return estimate;
+
+    double mean = sum / sampleCount;
+    double squaredDeviationSum = 0;
+    for (float area : areas)
+        squaredDeviationSum += (area - mean) * (area - mean);
+
+    constexpr double z = 1.96;
+    double standardDeviation = sampleCount > 1 ? std::sqrt(squaredDeviationSum / (sampleCount - 1)) : 0;
+    estimate.avgArea = mean;
+    estimate.avgAreaMargin = isExhaustive ? 0 : z * standardDeviation / std::sqrt(double(sampleCount));
+
+    // Quantile intervals come from the normal approximation of the binomial rank distribution
+    std::sort(areas.begin(), areas.end());
+    for (int i = 0; i < areaQuantileCount; i++)
+    {
+        double q = areaQuantiles[i];
+        double rankMargin = isExhaustive ? 0 : z * std::sqrt(sampleCount * q * (1 - q));
+        auto AreaAtRank = [&](double rank) { return areas[std::clamp<long>(std::lround(rank), 0, long(sampleCount) - 1)]; };
+
+        estimate.quantileAreas[i] = AreaAtRank(q * (sampleCount - 1));
+        estimate.quantileLowAreas[i] = AreaAtRank(q * (sampleCount - 1) - rankMargin);
+        estimate.quantileHighAreas[i] = AreaAtRank(q * (sampleCount - 1) + rankMargin);
+    }
+
+    return estimate;
 }
 
 void Mesh::Subdivide()
 {
+    if (!EnsureResident())
+        return;
+
+    AllocationScope allocationScope("Subdivide");
+
     // At least twice more
     vertices.reserve(vertices.size() * 2);
 
     // For each triangle make 4 new
-    std::vector<int> newIndices;
+    IndexArray newIndices;
     newIndices.reserve(indices.size() * 4);
 
-    std::unordered_map<size_t, int> availableNewVertexIdxs;
+    // Edges are listed under their lower vertex index, with room for every triangle corner that could add one.
+    // Vertices have only a few edges each, so a lookup scans a short contiguous list near the vertex's neighbors
+    // instead of chasing hash map nodes spread over the heap. These are the largest temporaries here, so they
+    // go through the mesh allocator and land on huge pages like the mesh arrays
+    std::vector<int, MeshAllocator<int>> edgeOffsets(vertices.size() + 1, 0);
+    for (int i = 0; i < indices.size(); i += 3)
+    {
+        edgeOffsets[std::min(indices[i], indices[i + 1]) + 1]++;
+        edgeOffsets[std::min(indices[i + 1], indices[i + 2]) + 1]++;
+        edgeOffsets[std::min(indices[i], indices[i + 2]) + 1]++;
+    }
+    std::partial_sum(edgeOffsets.begin(), edgeOffsets.end(), edgeOffsets.begin());
+
+    std::vector<int, MeshAllocator<int>> edgeCounts(vertices.size(), 0);
+    std::vector<std::pair<int, int>, MeshAllocator<std::pair<int, int>>> edgeMidpoints(edgeOffsets.back());
+    auto getMidpointIdx = [&](int v1, int v2, const glm::vec3& midpoint)
+    {
+        int minIdx = std::min(v1, v2);
+        int maxIdx = std::max(v1, v2);
+        auto begin = edgeMidpoints.begin() + edgeOffsets[minIdx];
+        auto end = begin + edgeCounts[minIdx];
+        for (auto edge = begin; edge != end; edge++)
+        {
+            if (edge->first == maxIdx)
+                return edge->second;
+        }
+
+        int midpointIdx = vertices.size();
+        *end = { maxIdx, midpointIdx };
+        edgeCounts[minIdx]++;
+        vertices.emplace_back(Vertex(midpoint, glm::vec3(0)));
+        return midpointIdx;
+    };
+
     for (int i = 0; i < indices.size(); i += 3)
     {
         const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
@@ -198,40 +581,10 @@ void Mesh::Subdivide()
         triangle.vB->normal = glm::vec3(0);
         triangle.vC->normal = glm::vec3(0);
 
-        // Hash edges and add new vertices for each unique edge at the midpoint
-        size_t edgeHashAC = HashCombine(indices[i], indices[i + 2]);
-        size_t edgeHashAB = HashCombine(indices[i], indices[i + 1]);
-        size_t edgeHashBC = HashCombine(indices[i + 1], indices[i + 2]);
-
-        int midpointACIdx;
-        int midpointABIdx;
-        int midpointBCIdx;
-        if (!availableNewVertexIdxs.count(edgeHashAC))
-        {
-            midpointACIdx = vertices.size();
-            availableNewVertexIdxs.insert({edgeHashAC, midpointACIdx});
-            vertices.emplace_back(Vertex(midpointAC, glm::vec3(0)));
-        }
-        else
-            midpointACIdx = availableNewVertexIdxs.at(edgeHashAC);
-
-        if (!availableNewVertexIdxs.count(edgeHashAB))
-        {
-            midpointABIdx = vertices.size();
-            availableNewVertexIdxs.insert({edgeHashAB, midpointABIdx});
-            vertices.emplace_back(Vertex(midpointAB, glm::vec3(0)));
-        }
-        else
-            midpointABIdx = availableNewVertexIdxs.at(edgeHashAB);
-
-        if (!availableNewVertexIdxs.count(edgeHashBC))
-        {
-            midpointBCIdx = vertices.size();
-            availableNewVertexIdxs.insert({edgeHashBC, midpointBCIdx});
-            vertices.emplace_back(Vertex(midpointBC, glm::vec3(0)));
-        }
-        else
-            midpointBCIdx = availableNewVertexIdxs.at(edgeHashBC);
+        // Add new vertices for each unique edge at the midpoint
+        int midpointACIdx = getMidpointIdx(indices[i], indices[i + 2], midpointAC);
+        int midpointABIdx = getMidpointIdx(indices[i], indices[i + 1], midpointAB);
+        int midpointBCIdx = getMidpointIdx(indices[i + 1], indices[i + 2], midpointBC);
 
         // Counter-clockwise order
         newIndices.push_back(indices[i]);
@@ -252,17 +605,19 @@ void Mesh::Subdivide()
     }
 
     indices = std::move(newIndices);
+    subdivisionLevel++;
 
-    CalculateNormals();
+    CalculateNormalsAndStatistics();
+    UpdateMetadata();
 }
 
 // Möller–Trumbore intersection (yoinked from Wikipedia)
-bool DoesRayIntersectTriangle(glm::vec3 ray_origin, glm::vec3 ray_vector, const Triangle& triangle)
+bool DoesRayIntersectTriangle(glm::vec3 ray_origin, glm::vec3 ray_vector, glm::vec3 a, glm::vec3 b, glm::vec3 c)
 {
     constexpr float epsilon = std::numeric_limits<float>::epsilon();
 
-    glm::vec3 edge1 = triangle.vB->position - triangle.vA->position;
-    glm::vec3 edge2 = triangle.vC->position - triangle.vA->position;
+    glm::vec3 edge1 = b - a;
+    glm::vec3 edge2 = c - a;
     glm::vec3 ray_cross_e2 = cross(ray_vector, edge2);
     float det = dot(edge1, ray_cross_e2);
 
@@ -270,7 +625,7 @@ bool DoesRayIntersectTriangle(glm::vec3 ray_origin, glm::vec3 ray_vector, const
         return false;    // This ray is parallel to this triangle.
 
     float inv_det = 1.0 / det;
-    glm::vec3 s = ray_origin - triangle.vA->position;
+    glm::vec3 s = ray_origin - a;
     float u = inv_det * dot(s, ray_cross_e2);
 
     if (u < 0 || u > 1)
@@ -295,6 +650,9 @@ bool DoesRayIntersectTriangle(glm::vec3 ray_origin, glm::vec3 ray_vector, const
 
 bool Mesh::IsPointInside(const glm::vec3 p)
 {
+    if (!EnsureResident())
+        return false;
+
     const glm::vec3 rayOrigin = p;
     const glm::vec3 rayDirection = glm::vec3(1.0f, 1.0f, 0.0f);
     int intersectionCount = 0;
@@ -302,7 +660,7 @@ bool Mesh::IsPointInside(const glm::vec3 p)
     for (int i = 0; i < indices.size(); i += 3)
     {
         const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
-        if (DoesRayIntersectTriangle(rayOrigin, rayDirection, triangle))
+        if (DoesRayIntersectTriangle(rayOrigin, rayDirection, triangle.vA->position, triangle.vB->position, triangle.vC->position))
             intersectionCount++;
     }
 
@@ -1,16 +1,25 @@
 #pragma once
 
 #include "glm/glm.hpp"
+#include <atomic>
+#include <memory>
+#include <string>
 #include <vector>
 
+#include "mesh_allocator.h"
+
 struct Vertex
 {
     glm::vec3 position;
     glm::vec3 normal;
 
+    Vertex() = default;
     Vertex(glm::vec3 position, glm::vec3 normal);
 };
 
+using VertexArray = std::vector<Vertex, MeshAllocator<Vertex>>;
+using IndexArray = std::vector<int, MeshAllocator<int>>;
+
 struct Triangle
 {
     Vertex* vA;
@@ -22,7 +31,7 @@ struct Triangle
     {
     }
 
-    static const Triangle GetTriangle(std::vector<Vertex>& vertices, const std::vector<int>& indices, size_t i)
+    static const Triangle GetTriangle(VertexArray& vertices, const IndexArray& indices, size_t i)
     {
         return Triangle(&vertices[indices[i]], &vertices[indices[i + 1]], &vertices[indices[i + 2]]);
     }
@@ -35,31 +44,121 @@ struct Triangle
     }
 };
 
+bool DoesRayIntersectTriangle(glm::vec3 ray_origin, glm::vec3 ray_vector, glm::vec3 a, glm::vec3 b, glm::vec3 c);
+
+constexpr int areaQuantileCount = 3;
+constexpr float areaQuantiles[areaQuantileCount] = { 0.1f, 0.5f, 0.9f };
+
 struct TriangleStatistics
 {
     float minArea;
     float maxArea;
     float avgArea;
 
+    // Exact quantiles, filled by every full pass over the triangles
+    float quantileAreas[areaQuantileCount];
+
     TriangleStatistics();
 };
 
+// Estimates from a uniform random sample of triangles with 95% confidence intervals
+struct ApproximateStatistics
+{
+    size_t sampleCount;
+    float avgArea;
+    float avgAreaMargin;
+    float quantileAreas[areaQuantileCount];
+    float quantileLowAreas[areaQuantileCount];
+    float quantileHighAreas[areaQuantileCount];
+};
+
+struct Bounds
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    Bounds();
+    void Extend(glm::vec3 p);
+};
+
 class Mesh
 {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<int> indices;
+    VertexArray vertices;
+    IndexArray indices;
+
+    // Metadata that stays valid while the CPU arrays are released
+    size_t vertexCount;
+    size_t indexCount;
+    size_t topologyHash;
+    Bounds bounds;
 
     Mesh(const char* path);
     Mesh(Mesh&& other)
-        : vertices(std::move(other.vertices)), indices(std::move(other.indices))
+        : vertices(std::move(other.vertices)), indices(std::move(other.indices)),
+          vertexCount(other.vertexCount), indexCount(other.indexCount), topologyHash(other.topologyHash), bounds(other.bounds),
+          path(std::move(other.path)), subdivisionLevel(other.subdivisionLevel), isResident(other.isResident),
+          statistics(other.statistics), hasStatistics(other.hasStatistics), areNormalsDeferred(other.areNormalsDeferred)
     {
     }
 
+    // Returns nullptr instead of exiting when the file cannot be loaded or the load was cancelled.
+    // Normals and statistics are calculated while loading unless deferred, so a pipeline can run
+    // them as a stage of their own with CalculateDeferredNormals
+    static std::unique_ptr<Mesh> TryLoad(const char* path, const std::atomic<bool>* isCancelled = nullptr, bool shouldDeferNormals = false);
+
+    // Calculates the normals the file did not supply and the statistics after a deferred load
+    void CalculateDeferredNormals();
+
+    // Statistics are gathered while loading and subdividing, only a load that deferred them leaves them out.
+    // While they are there the calculations below return them without touching the CPU arrays
+    bool HasStatistics() const { return hasStatistics; }
     void CalculateStatistics(TriangleStatistics& stats, bool& didCalculate);
+
+    // Single threaded and blocking, for callers that already run one mesh per thread. Keeps the result
+    TriangleStatistics CalculateStatistics();
+
+    // Samples a fixed number of triangles, fast enough to show while the full pass runs
+    ApproximateStatistics EstimateStatistics(size_t sampleCount = 4096);
+
+    // Zeroes the normals and scatters every triangle's normal into its vertices again, refreshing the
+    // statistics on the way. Normals supplied by the file are replaced
+    void RecalculateNormals();
+
     bool IsPointInside(glm::vec3 p);
     void Subdivide();
 
+    // View-only residency: free the CPU arrays once they are on the GPU and
+    // rebuild them from the source file when a CPU operation needs them.
+    // EnsureResident returns false, leaving the metadata as it was, when the file can no longer be loaded
+    void ReleaseCpuData();
+    bool EnsureResident();
+    bool IsResident() const { return isResident; }
+
+    // Hands back arrays that were kept elsewhere after ReleaseCpuData, such as the mesh cache
+    void RestoreCpuData(VertexArray&& vertices, IndexArray&& indices);
+
+    const std::string& GetPath() const { return path; }
+    int GetSubdivisionLevel() const { return subdivisionLevel; }
+
 private:
-    void CalculateNormals();
+    std::string path;
+    int subdivisionLevel;
+    bool isResident;
+
+    // Kept with the metadata so it survives ReleaseCpuData
+    TriangleStatistics statistics;
+    bool hasStatistics;
+    bool areNormalsDeferred;
+
+    Mesh();
+
+    bool Load(const std::atomic<bool>* isCancelled = nullptr, bool shouldDeferNormals = false);
+    bool LoadJson(bool& hasNormals, bool& hasBounds, const std::atomic<bool>* isCancelled, bool shouldDeferNormals);
+    void UpdateMetadata(bool shouldCalculateBounds = true);
+    void CalculateNormalsAndStatistics(bool shouldCalculateNormals = true);
+    void AccumulateTriangle(size_t i, bool shouldAccumulateNormals, float* areas, int triangleCount);
+
+    static TriangleStatistics CalculateRangeStatistics(
+        VertexArray& vertices, const IndexArray& indices, int start, int end, int triangleCount, float* areas = nullptr);
 };
@@ -0,0 +1,110 @@
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "allocation_tracker.h"
+#include "mesh_allocator.h"
+
+MeshAllocatorSettings meshAllocatorSettings;
+
+constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+struct HugeRegion
+{
+    size_t size;
+
+    // Regions are mapped around operator new, so the allocations build counts them here
+    int allocationScope;
+};
+
+// Huge page regions are few and large, so tracking them by address is cheap
+// and lets settings change without breaking deallocation of older blocks
+static std::mutex hugeRegionsMutex;
+static std::unordered_map<void*, HugeRegion> hugeRegions;
+
+static void* AllocateHugePages(size_t size)
+{
+#ifdef __linux__
+    if (meshAllocatorSettings.useHugeTLB)
+    {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED)
+            return ptr;
+    }
+
+    // Over-allocate by one huge page and trim so the region starts on a 2 MB boundary
+    size_t mappedSize = size + hugePageSize;
+    char* mapped = static_cast<char*>(mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    uintptr_t address = reinterpret_cast<uintptr_t>(mapped);
+    char* aligned = reinterpret_cast<char*>((address + hugePageSize - 1) & ~(hugePageSize - 1));
+    size_t head = aligned - mapped;
+    size_t tail = mappedSize - head - size;
+
+    if (head > 0)
+        munmap(mapped, head);
+    if (tail > 0)
+        munmap(aligned + size, tail);
+
+    madvise(aligned, size, MADV_HUGEPAGE);
+    return aligned;
+#else
+    return std::aligned_alloc(hugePageSize, size);
+#endif
+}
+
+static void FreeHugePages(void* ptr, size_t size)
+{
+#ifdef __linux__
+    munmap(ptr, size);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* AllocateMeshStorage(size_t bytes)
+{
+    if (!meshAllocatorSettings.useHugePages || bytes < meshAllocatorSettings.hugePageThreshold || bytes < hugePageSize)
+        return ::operator new(bytes);
+
+    size_t size = (bytes + hugePageSize - 1) & ~(hugePageSize - 1);
+    void* ptr = AllocateHugePages(size);
+    if (!ptr)
+        return ::operator new(bytes);
+
+    int allocationScope = AddExternalAllocation(bytes);
+    std::lock_guard<std::mutex> lock(hugeRegionsMutex);
+    hugeRegions.insert({ptr, { size, allocationScope }});
+    return ptr;
+}
+
+void FreeMeshStorage(void* ptr, size_t bytes)
+{
+    if (!ptr)
+        return;
+
+    if (bytes >= hugePageSize)
+    {
+        std::unique_lock<std::mutex> lock(hugeRegionsMutex);
+        auto region = hugeRegions.find(ptr);
+        if (region != hugeRegions.end())
+        {
+            HugeRegion freedRegion = region->second;
+            hugeRegions.erase(region);
+            lock.unlock();
+
+            RemoveExternalAllocation(freedRegion.allocationScope, bytes);
+            FreeHugePages(ptr, freedRegion.size);
+            return;
+        }
+    }
+
+    ::operator delete(ptr);
+}
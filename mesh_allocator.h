@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+struct MeshAllocatorSettings
+{
+    // Allocations at or above the threshold are placed in 2 MB aligned huge page regions
+    bool useHugePages = true;
+    bool useHugeTLB = false;
+    size_t hugePageThreshold = 8 * 1024 * 1024;
+};
+
+extern MeshAllocatorSettings meshAllocatorSettings;
+
+void* AllocateMeshStorage(size_t bytes);
+void FreeMeshStorage(void* ptr, size_t bytes);
+
+template<typename T>
+struct MeshAllocator
+{
+    using value_type = T;
+
+    MeshAllocator() = default;
+
+    template<typename U>
+    MeshAllocator(const MeshAllocator<U>&)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(AllocateMeshStorage(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        FreeMeshStorage(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const MeshAllocator<U>&) const { return true; }
+};
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mesh_binary.h"
+
+uint64_t GetChunkTableOffset()
+{
+    return sizeof(BinaryMeshHeader);
+}
+
+uint64_t GetPositionsOffset(const BinaryMeshHeader& header)
+{
+    return GetChunkTableOffset() + header.chunkCount * sizeof(BinaryMeshChunk);
+}
+
+uint64_t GetIndicesOffset(const BinaryMeshHeader& header)
+{
+    return GetPositionsOffset(header) + header.vertexCount * sizeof(glm::vec3);
+}
+
+bool ReadFully(int fd, void* data, size_t size, uint64_t offset)
+{
+    char* dst = static_cast<char*>(data);
+    while (size > 0)
+    {
+        ssize_t count = pread(fd, dst, size, offset);
+        if (count <= 0)
+            return false;
+
+        dst += count;
+        size -= count;
+        offset += count;
+    }
+
+    return true;
+}
+
+bool ReadBinaryMeshHeader(int fd, BinaryMeshHeader& header)
+{
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || !ReadFully(fd, &header, sizeof(header), 0))
+        return false;
+
+    if (memcmp(header.magic, "MBIN", 4) != 0 || header.version != binaryMeshVersion || header.chunkTriangleCount == 0)
+        return false;
+
+    // Counts are checked against the file size one by one before they are added up, so a corrupt header can
+    // neither overflow the offsets nor make readers allocate more than the file holds
+    uint64_t fileSize = fileStat.st_size;
+    uint64_t triangleCount = header.indexCount / 3;
+    return header.indexCount % 3 == 0 && header.chunkTriangleCount <= UINT32_MAX && header.chunkCount <= fileSize / sizeof(BinaryMeshChunk)
+        && header.vertexCount <= fileSize / sizeof(glm::vec3) && header.indexCount <= fileSize / sizeof(int)
+        && header.chunkCount == triangleCount / header.chunkTriangleCount + (triangleCount % header.chunkTriangleCount != 0)
+        && GetIndicesOffset(header) + header.indexCount * sizeof(int) <= fileSize;
+}
+
+bool WriteBinaryMesh(const Mesh& mesh, const char* path, uint64_t chunkTriangleCount)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open file for writing" << std::endl;
+        return false;
+    }
+
+    const VertexArray& vertices = mesh.vertices;
+    const IndexArray& indices = mesh.indices;
+
+    BinaryMeshHeader header;
+    memcpy(header.magic, "MBIN", 4);
+    header.version = binaryMeshVersion;
+    header.vertexCount = vertices.size();
+    header.indexCount = indices.size();
+    header.chunkTriangleCount = chunkTriangleCount;
+    header.chunkCount = (indices.size() / 3 + chunkTriangleCount - 1) / chunkTriangleCount;
+    fwrite(&header, sizeof(header), 1, file);
+
+    // Per-chunk bounds let streaming queries skip whole chunks
+    for (uint64_t chunk = 0; chunk < header.chunkCount; chunk++)
+    {
+        BinaryMeshChunk chunkBounds = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+        size_t end = std::min<size_t>((chunk + 1) * chunkTriangleCount * 3, indices.size());
+        for (size_t i = chunk * chunkTriangleCount * 3; i < end; i++)
+        {
+            chunkBounds.min = glm::min(chunkBounds.min, vertices[indices[i]].position);
+            chunkBounds.max = glm::max(chunkBounds.max, vertices[indices[i]].position);
+        }
+
+        fwrite(&chunkBounds, sizeof(chunkBounds), 1, file);
+    }
+
+    for (const Vertex& vertex : vertices)
+        fwrite(&vertex.position, sizeof(glm::vec3), 1, file);
+
+    fwrite(indices.data(), sizeof(int), indices.size(), file);
+
+    bool didWrite = !ferror(file);
+    fclose(file);
+
+    if (!didWrite)
+        std::cerr << "Failed to write binary mesh" << std::endl;
+
+    return didWrite;
+}
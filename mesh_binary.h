@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+
+// Chunked binary mesh layout:
+// header | chunk table | positions (vec3 per vertex) | indices (3 ints per triangle)
+// Triangles are grouped into fixed-size chunks, each with its own bounds
+struct BinaryMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t chunkTriangleCount;
+    uint64_t chunkCount;
+};
+
+struct BinaryMeshChunk
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+constexpr uint32_t binaryMeshVersion = 1;
+constexpr uint64_t defaultChunkTriangleCount = 64 * 1024;
+
+uint64_t GetChunkTableOffset();
+uint64_t GetPositionsOffset(const BinaryMeshHeader& header);
+uint64_t GetIndicesOffset(const BinaryMeshHeader& header);
+
+// Fails unless the counts in the header describe a layout that fits in the file
+bool ReadBinaryMeshHeader(int fd, BinaryMeshHeader& header);
+bool ReadFully(int fd, void* data, size_t size, uint64_t offset);
+
+bool WriteBinaryMesh(const Mesh& mesh, const char* path, uint64_t chunkTriangleCount = defaultChunkTriangleCount);
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <zlib.h>
+
+#include "mesh_cache.h"
+#include "metrics.h"
+
+// Chunks of 1 MB of 4 byte words are compressed independently
+constexpr size_t chunkWordCount = 256 * 1024;
+
+static MetricsGauge rawBytesGauge("viewer_mesh_cache_bytes", "tier=\"raw\"", "Bytes held by the mesh cache, compressed size for the compressed tier.");
+static MetricsGauge compressedBytesGauge("viewer_mesh_cache_bytes", "tier=\"compressed\"", "");
+static LatencyHistogram restoreTimes("viewer_mesh_cache_restore_seconds", "", "Time to restore a mesh from the compressed tier.");
+
+template<typename Function>
+static void ForEachChunkParallel(size_t chunkCount, Function function)
+{
+    size_t threadCount = std::min<size_t>(chunkCount, std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<std::future<void>> futures;
+    for (size_t t = 0; t < threadCount; t++)
+    {
+        futures.emplace_back(std::async(
+            std::launch::async,
+            [&, t]
+            {
+                for (size_t i = t; i < chunkCount; i += threadCount)
+                    function(i);
+            }));
+    }
+
+    for (auto& future : futures)
+        future.get();
+}
+
+static size_t GetChunkCount(size_t wordCount)
+{
+    return (wordCount + chunkWordCount - 1) / chunkWordCount;
+}
+
+// Groups the bytes of the words by significance before deflating, exponents and high
+// bytes of nearby values repeat far more often than whole words do
+static std::vector<unsigned char> CompressWords(const uint32_t* words, size_t count)
+{
+    std::vector<unsigned char> shuffled(count * 4);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (size_t b = 0; b < 4; b++)
+            shuffled[b * count + i] = (words[i] >> (8 * b)) & 0xff;
+    }
+
+    uLongf size = compressBound(shuffled.size());
+    std::vector<unsigned char> data(size);
+
+    // An empty chunk fails to restore, so the mesh is then parsed from its file again
+    if (compress2(data.data(), &size, shuffled.data(), shuffled.size(), Z_BEST_SPEED) != Z_OK)
+        size = 0;
+    data.resize(size);
+    data.shrink_to_fit();
+    return data;
+}
+
+static bool DecompressWords(const std::vector<unsigned char>& data, uint32_t* words, size_t count)
+{
+    std::vector<unsigned char> shuffled(count * 4);
+    uLongf size = shuffled.size();
+    if (uncompress(shuffled.data(), &size, data.data(), data.size()) != Z_OK || size != shuffled.size())
+        return false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        words[i] = uint32_t(shuffled[i]) | uint32_t(shuffled[count + i]) << 8 | uint32_t(shuffled[2 * count + i]) << 16
+                   | uint32_t(shuffled[3 * count + i]) << 24;
+    }
+
+    return true;
+}
+
+static std::filesystem::file_time_type GetWriteTime(const std::string& path)
+{
+    std::error_code error;
+    return std::filesystem::last_write_time(path, error);
+}
+
+void MeshCache::Put(std::unique_ptr<Mesh> mesh)
+{
+    if (!mesh || !mesh->IsResident() || mesh->GetSubdivisionLevel() > 0)
+        return;
+
+    Entry entry;
+    entry.writeTime = GetWriteTime(mesh->GetPath());
+    entry.bytes = mesh->vertexCount * sizeof(Vertex) + mesh->indexCount * sizeof(int);
+    entry.mesh = std::move(mesh);
+
+    // Collect the least recently used raw meshes over budget and compress them outside the lock
+    std::list<Entry> demoted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto existing = Find(rawEntries, entry.mesh->GetPath());
+        if (existing != rawEntries.end())
+        {
+            stats.rawBytes -= existing->bytes;
+            rawEntries.erase(existing);
+        }
+
+        stats.rawBytes += entry.bytes;
+        rawEntries.push_front(std::move(entry));
+
+        while (stats.rawBytes > settings.rawBudget && !rawEntries.empty())
+        {
+            stats.rawBytes -= rawEntries.back().bytes;
+            demoted.splice(demoted.end(), rawEntries, std::prev(rawEntries.end()));
+        }
+
+        stats.rawCount = rawEntries.size();
+    }
+
+    for (Entry& demotedEntry : demoted)
+        Compress(demotedEntry);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Entry& demotedEntry : demoted)
+    {
+        auto existing = Find(compressedEntries, demotedEntry.mesh->GetPath());
+        if (existing != compressedEntries.end())
+        {
+            stats.compressedBytes -= existing->compressedBytes;
+            stats.compressedSourceBytes -= existing->bytes;
+            compressedEntries.erase(existing);
+        }
+
+        stats.compressedBytes += demotedEntry.compressedBytes;
+        stats.compressedSourceBytes += demotedEntry.bytes;
+        compressedEntries.push_front(std::move(demotedEntry));
+    }
+
+    while (stats.compressedBytes > settings.compressedBudget && !compressedEntries.empty())
+    {
+        stats.compressedBytes -= compressedEntries.back().compressedBytes;
+        stats.compressedSourceBytes -= compressedEntries.back().bytes;
+        compressedEntries.pop_back();
+    }
+
+    stats.compressedCount = compressedEntries.size();
+    rawBytesGauge.Set(stats.rawBytes);
+    compressedBytesGauge.Set(stats.compressedBytes);
+}
+
+std::unique_ptr<Mesh> MeshCache::Take(const std::string& path)
+{
+    Entry entry;
+    bool isCompressed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto raw = Find(rawEntries, path);
+        auto compressed = Find(compressedEntries, path);
+        if (raw != rawEntries.end())
+        {
+            entry = std::move(*raw);
+            stats.rawBytes -= entry.bytes;
+            rawEntries.erase(raw);
+        }
+        else if (compressed != compressedEntries.end())
+        {
+            entry = std::move(*compressed);
+            stats.compressedBytes -= entry.compressedBytes;
+            stats.compressedSourceBytes -= entry.bytes;
+            compressedEntries.erase(compressed);
+            isCompressed = true;
+        }
+        else
+            return nullptr;
+
+        stats.rawCount = rawEntries.size();
+        stats.compressedCount = compressedEntries.size();
+        rawBytesGauge.Set(stats.rawBytes);
+        compressedBytesGauge.Set(stats.compressedBytes);
+    }
+
+    // The file was edited after the mesh was cached
+    if (entry.writeTime != GetWriteTime(path))
+        return nullptr;
+
+    if (isCompressed)
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        if (!Restore(entry))
+        {
+            std::cerr << "Failed to restore cached mesh " << path << std::endl;
+            return nullptr;
+        }
+
+        double restoreMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        restoreTimes.Record(restoreMs / 1000);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.lastRestoreMs = restoreMs;
+    }
+
+    return std::move(entry.mesh);
+}
+
+void MeshCache::Remove(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto raw = Find(rawEntries, path);
+    if (raw != rawEntries.end())
+    {
+        stats.rawBytes -= raw->bytes;
+        rawEntries.erase(raw);
+    }
+
+    auto compressed = Find(compressedEntries, path);
+    if (compressed != compressedEntries.end())
+    {
+        stats.compressedBytes -= compressed->compressedBytes;
+        stats.compressedSourceBytes -= compressed->bytes;
+        compressedEntries.erase(compressed);
+    }
+
+    stats.rawCount = rawEntries.size();
+    stats.compressedCount = compressedEntries.size();
+    rawBytesGauge.Set(stats.rawBytes);
+    compressedBytesGauge.Set(stats.compressedBytes);
+}
+
+bool MeshCache::Contains(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return Find(rawEntries, path) != rawEntries.end() || Find(compressedEntries, path) != compressedEntries.end();
+}
+
+MeshCacheStats MeshCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void MeshCache::Compress(Entry& entry)
+{
+    Mesh& mesh = *entry.mesh;
+    const uint32_t* vertexWords = reinterpret_cast<const uint32_t*>(mesh.vertices.data());
+    size_t vertexWordCount = mesh.vertices.size() * sizeof(Vertex) / sizeof(uint32_t);
+    size_t indexCount = mesh.indices.size();
+
+    entry.vertexChunks.resize(GetChunkCount(vertexWordCount));
+    ForEachChunkParallel(
+        entry.vertexChunks.size(),
+        [&](size_t i)
+        {
+            size_t start = i * chunkWordCount;
+            size_t count = std::min(chunkWordCount, vertexWordCount - start);
+            entry.vertexChunks[i] = { CompressWords(vertexWords + start, count), count };
+        });
+
+    // Indices of neighboring triangles are close, so zigzag encoded deltas are mostly small
+    entry.indexChunks.resize(GetChunkCount(indexCount));
+    ForEachChunkParallel(
+        entry.indexChunks.size(),
+        [&](size_t i)
+        {
+            size_t start = i * chunkWordCount;
+            size_t count = std::min(chunkWordCount, indexCount - start);
+
+            std::vector<uint32_t> deltas(count);
+            int previous = 0;
+            for (size_t j = 0; j < count; j++)
+            {
+                int32_t delta = mesh.indices[start + j] - previous;
+                deltas[j] = uint32_t(delta << 1) ^ uint32_t(delta >> 31);
+                previous = mesh.indices[start + j];
+            }
+
+            entry.indexChunks[i] = { CompressWords(deltas.data(), count), count };
+        });
+
+    entry.compressedBytes = 0;
+    for (const CompressedChunk& chunk : entry.vertexChunks)
+        entry.compressedBytes += chunk.data.size();
+    for (const CompressedChunk& chunk : entry.indexChunks)
+        entry.compressedBytes += chunk.data.size();
+
+    mesh.ReleaseCpuData();
+}
+
+bool MeshCache::Restore(Entry& entry)
+{
+    Mesh& mesh = *entry.mesh;
+    VertexArray vertices(mesh.vertexCount);
+    IndexArray indices(mesh.indexCount);
+
+    std::atomic<bool> isValid = true;
+    uint32_t* vertexWords = reinterpret_cast<uint32_t*>(vertices.data());
+    ForEachChunkParallel(
+        entry.vertexChunks.size(),
+        [&](size_t i)
+        {
+            const CompressedChunk& chunk = entry.vertexChunks[i];
+            if (!DecompressWords(chunk.data, vertexWords + i * chunkWordCount, chunk.wordCount))
+                isValid = false;
+        });
+
+    uint32_t* indexWords = reinterpret_cast<uint32_t*>(indices.data());
+    ForEachChunkParallel(
+        entry.indexChunks.size(),
+        [&](size_t i)
+        {
+            const CompressedChunk& chunk = entry.indexChunks[i];
+            uint32_t* words = indexWords + i * chunkWordCount;
+            if (!DecompressWords(chunk.data, words, chunk.wordCount))
+            {
+                isValid = false;
+                return;
+            }
+
+            int previous = 0;
+            for (size_t j = 0; j < chunk.wordCount; j++)
+            {
+                int32_t delta = int32_t(words[j] >> 1) ^ -int32_t(words[j] & 1);
+                previous += delta;
+                words[j] = uint32_t(previous);
+            }
+        });
+
+    entry.vertexChunks.clear();
+    entry.indexChunks.clear();
+    if (!isValid)
+        return false;
+
+    mesh.RestoreCpuData(std::move(vertices), std::move(indices));
+    return true;
+}
+
+std::list<MeshCache::Entry>::iterator MeshCache::Find(std::list<Entry>& entries, const std::string& path)
+{
+    return std::find_if(entries.begin(), entries.end(), [&path](const Entry& entry) { return entry.mesh->GetPath() == path; });
+}
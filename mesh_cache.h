@@ -0,0 +1,82 @@
+#pragma once
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+
+struct MeshCacheSettings
+{
+    // Meshes beyond the raw budget are compressed, compressed ones beyond their budget are dropped
+    size_t rawBudget = 512 * 1024 * 1024;
+    size_t compressedBudget = 512 * 1024 * 1024;
+};
+
+struct MeshCacheStats
+{
+    size_t rawCount = 0;
+    size_t compressedCount = 0;
+    size_t rawBytes = 0;
+    size_t compressedBytes = 0;
+
+    // Uncompressed size of the meshes in the compressed tier
+    size_t compressedSourceBytes = 0;
+    double lastRestoreMs = 0;
+
+    float GetCompressionRatio() const { return compressedBytes > 0 ? float(compressedSourceBytes) / compressedBytes : 0.0f; }
+};
+
+// Two tier LRU cache of recently viewed meshes keyed by path. Evicted raw meshes are kept
+// compressed in independent chunks: vertex floats and delta coded indices are byte shuffled
+// and deflated, so they restore in parallel and faster than parsing the source file again
+class MeshCache
+{
+public:
+    MeshCacheSettings settings;
+
+    // Takes ownership of a resident, unsubdivided mesh, others are dropped
+    void Put(std::unique_ptr<Mesh> mesh);
+
+    // Removes and returns the mesh for the path, restoring it from the compressed tier if needed.
+    // Returns nullptr when the path is not cached, the file changed since it was cached or the
+    // compressed copy does not decompress to the cached sizes, the mesh is then loaded from its file
+    std::unique_ptr<Mesh> Take(const std::string& path);
+
+    // Drops the mesh for the path from either tier without restoring it
+    void Remove(const std::string& path);
+
+    bool Contains(const std::string& path);
+    MeshCacheStats GetStats();
+
+private:
+    struct CompressedChunk
+    {
+        std::vector<unsigned char> data;
+        size_t wordCount;
+    };
+
+    struct Entry
+    {
+        std::unique_ptr<Mesh> mesh;
+        std::filesystem::file_time_type writeTime;
+        size_t bytes = 0;
+
+        // Only set in the compressed tier, the mesh then holds metadata only
+        std::vector<CompressedChunk> vertexChunks;
+        std::vector<CompressedChunk> indexChunks;
+        size_t compressedBytes = 0;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> rawEntries;
+    std::list<Entry> compressedEntries;
+    MeshCacheStats stats;
+
+    void Compress(Entry& entry);
+    bool Restore(Entry& entry);
+    std::list<Entry>::iterator Find(std::list<Entry>& entries, const std::string& path);
+};
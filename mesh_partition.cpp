@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <future>
+#include <numeric>
+#include <thread>
+
+#include "mesh_partition.h"
+
+// Coarsening stops once the graph is this many nodes per partition or barely shrinks
+constexpr size_t coarsestNodesPerPartition = 32;
+constexpr float minCoarseningRatio = 0.9f;
+
+// Partitions may exceed the even share of triangles by this much during refinement
+constexpr float maxImbalance = 1.03f;
+constexpr int refinementPassCount = 4;
+
+struct PartitionGraph
+{
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> neighbors;
+    std::vector<uint32_t> edgeWeights;
+    std::vector<uint32_t> nodeWeights;
+
+    size_t GetNodeCount() const { return nodeWeights.size(); }
+};
+
+// Triangles are nodes and triangles sharing an edge are connected
+static PartitionGraph BuildTriangleGraph(const IndexArray& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    // Triangles around each vertex, the other triangles of an edge are the ones around its first vertex that also use the second
+    std::vector<uint32_t> vertexTriangleOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        vertexTriangleOffsets[indices[i] + 1]++;
+    std::partial_sum(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end(), vertexTriangleOffsets.begin());
+
+    std::vector<uint32_t> vertexTriangles(vertexTriangleOffsets.back());
+    std::vector<uint32_t> cursors(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        vertexTriangles[cursors[indices[i]]++] = i / 3;
+
+    PartitionGraph graph;
+    graph.offsets.reserve(triangleCount + 1);
+    graph.offsets.push_back(0);
+    graph.nodeWeights.assign(triangleCount, 1);
+    graph.neighbors.reserve(triangleCount * 3);
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            int a = indices[t * 3 + corner];
+            int b = indices[t * 3 + (corner + 1) % 3];
+            for (uint32_t j = vertexTriangleOffsets[a]; j < vertexTriangleOffsets[a + 1]; j++)
+            {
+                uint32_t other = vertexTriangles[j];
+                if (other != t && (indices[other * 3] == b || indices[other * 3 + 1] == b || indices[other * 3 + 2] == b))
+                    graph.neighbors.push_back(other);
+            }
+        }
+        graph.offsets.push_back(graph.neighbors.size());
+    }
+
+    graph.edgeWeights.assign(graph.neighbors.size(), 1);
+    return graph;
+}
+
+// Matches every node with its unmatched neighbor along the heaviest edge and merges the pairs,
+// fineToCoarse receives the coarse node of every fine node. Nodes are visited in mesh order,
+// which keeps coarse nodes numbered along the surface and the coarse graphs cache friendly
+static PartitionGraph Coarsen(const PartitionGraph& graph, std::vector<uint32_t>& fineToCoarse)
+{
+    constexpr uint32_t unmatched = UINT32_MAX;
+    size_t nodeCount = graph.GetNodeCount();
+
+    fineToCoarse.assign(nodeCount, unmatched);
+    std::vector<uint32_t> members;
+    members.reserve(nodeCount * 2);
+    uint32_t coarseCount = 0;
+    for (uint32_t u = 0; u < nodeCount; u++)
+    {
+        if (fineToCoarse[u] != unmatched)
+            continue;
+
+        uint32_t match = u;
+        uint32_t matchWeight = 0;
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+        {
+            uint32_t v = graph.neighbors[e];
+            if (fineToCoarse[v] == unmatched && v != u && graph.edgeWeights[e] > matchWeight)
+            {
+                match = v;
+                matchWeight = graph.edgeWeights[e];
+            }
+        }
+
+        fineToCoarse[u] = coarseCount;
+        fineToCoarse[match] = coarseCount;
+        members.push_back(u);
+        members.push_back(match);
+        coarseCount++;
+    }
+
+    // Edges between the members of two coarse nodes merge into one, slots remembers where each neighbor was written
+    PartitionGraph coarse;
+    coarse.offsets.reserve(coarseCount + 1);
+    coarse.offsets.push_back(0);
+    coarse.nodeWeights.resize(coarseCount);
+    coarse.neighbors.reserve(graph.neighbors.size());
+    coarse.edgeWeights.reserve(graph.neighbors.size());
+    std::vector<uint32_t> slots(coarseCount, unmatched);
+    for (uint32_t c = 0; c < coarseCount; c++)
+    {
+        uint32_t first = members[c * 2];
+        uint32_t second = members[c * 2 + 1];
+        coarse.nodeWeights[c] = graph.nodeWeights[first] + (second != first ? graph.nodeWeights[second] : 0);
+
+        size_t start = coarse.neighbors.size();
+        for (uint32_t u : { first, second })
+        {
+            for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+            {
+                uint32_t neighbor = fineToCoarse[graph.neighbors[e]];
+                if (neighbor == c)
+                    continue;
+
+                if (slots[neighbor] == unmatched)
+                {
+                    slots[neighbor] = coarse.neighbors.size();
+                    coarse.neighbors.push_back(neighbor);
+                    coarse.edgeWeights.push_back(0);
+                }
+                coarse.edgeWeights[slots[neighbor]] += graph.edgeWeights[e];
+            }
+
+            if (second == first)
+                break;
+        }
+
+        for (size_t e = start; e < coarse.neighbors.size(); e++)
+            slots[coarse.neighbors[e]] = unmatched;
+        coarse.offsets.push_back(coarse.neighbors.size());
+    }
+
+    return coarse;
+}
+
+// Grows each partition breadth first from a node next to the previous ones until it holds its share of the weight
+static std::vector<int> GrowPartitions(const PartitionGraph& graph, int partitionCount)
+{
+    size_t nodeCount = graph.GetNodeCount();
+    uint64_t totalWeight = std::accumulate(graph.nodeWeights.begin(), graph.nodeWeights.end(), uint64_t(0));
+
+    std::vector<int> partitions(nodeCount, -1);
+    std::vector<uint32_t> queue;
+    std::vector<uint32_t> queueStamps(nodeCount, UINT32_MAX);
+    uint32_t stamp = 0;
+    uint64_t assignedWeight = 0;
+    size_t nextUnassigned = 0;
+    uint32_t lastNode = 0;
+    for (int p = 0; p < partitionCount - 1; p++)
+    {
+        uint64_t targetWeight = totalWeight * (p + 1) / partitionCount;
+        while (assignedWeight < targetWeight)
+        {
+            // Seed next to the last grown node so partitions follow each other, or anywhere once that region is used up
+            uint32_t seed = UINT32_MAX;
+            for (uint32_t e = graph.offsets[lastNode]; e < graph.offsets[lastNode + 1] && seed == UINT32_MAX; e++)
+            {
+                if (partitions[graph.neighbors[e]] < 0)
+                    seed = graph.neighbors[e];
+            }
+
+            while (seed == UINT32_MAX && nextUnassigned < nodeCount)
+            {
+                if (partitions[nextUnassigned] < 0)
+                    seed = nextUnassigned;
+                nextUnassigned++;
+            }
+
+            if (seed == UINT32_MAX)
+                break;
+
+            // Nodes are assigned when dequeued, so the ones still queued once the share is full stay in the pool
+            queue.assign(1, seed);
+            queueStamps[seed] = stamp;
+            for (size_t head = 0; head < queue.size() && assignedWeight < targetWeight; head++)
+            {
+                uint32_t u = queue[head];
+                partitions[u] = p;
+                assignedWeight += graph.nodeWeights[u];
+                lastNode = u;
+                for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+                {
+                    uint32_t v = graph.neighbors[e];
+                    if (partitions[v] < 0 && queueStamps[v] != stamp)
+                    {
+                        queueStamps[v] = stamp;
+                        queue.push_back(v);
+                    }
+                }
+            }
+            stamp++;
+        }
+    }
+
+    for (int& partition : partitions)
+    {
+        if (partition < 0)
+            partition = partitionCount - 1;
+    }
+
+    return partitions;
+}
+
+// Greedily moves boundary nodes to the neighboring partition they share the most edge weight with
+static void RefinePartitions(const PartitionGraph& graph, std::vector<int>& partitions, int partitionCount)
+{
+    std::vector<uint64_t> partitionWeights(partitionCount, 0);
+    for (size_t u = 0; u < graph.GetNodeCount(); u++)
+        partitionWeights[partitions[u]] += graph.nodeWeights[u];
+
+    uint64_t totalWeight = std::accumulate(partitionWeights.begin(), partitionWeights.end(), uint64_t(0));
+    uint64_t maxWeight = uint64_t(float(totalWeight) / partitionCount * maxImbalance) + 1;
+
+    std::vector<uint32_t> connections(partitionCount, 0);
+    std::vector<int> touched;
+    for (int pass = 0; pass < refinementPassCount; pass++)
+    {
+        size_t moveCount = 0;
+        for (uint32_t u = 0; u < graph.GetNodeCount(); u++)
+        {
+            int own = partitions[u];
+            for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+            {
+                int p = partitions[graph.neighbors[e]];
+                if (connections[p] == 0)
+                    touched.push_back(p);
+                connections[p] += graph.edgeWeights[e];
+            }
+
+            int best = own;
+            for (int p : touched)
+            {
+                bool isBetter = connections[p] > connections[best]
+                    || (connections[p] == connections[best] && partitionWeights[p] + graph.nodeWeights[u] < partitionWeights[best]);
+                if (p != own && isBetter && partitionWeights[p] + graph.nodeWeights[u] <= maxWeight)
+                    best = p;
+            }
+
+            if (best != own)
+            {
+                partitionWeights[own] -= graph.nodeWeights[u];
+                partitionWeights[best] += graph.nodeWeights[u];
+                partitions[u] = best;
+                moveCount++;
+            }
+
+            for (int p : touched)
+                connections[p] = 0;
+            connections[own] = 0;
+            touched.clear();
+        }
+
+        if (moveCount == 0)
+            break;
+    }
+}
+
+static std::vector<int> PartitionGraphMultilevel(const PartitionGraph& graph, int partitionCount)
+{
+    std::vector<PartitionGraph> levels;
+    std::vector<std::vector<uint32_t>> fineToCoarse;
+
+    const PartitionGraph* current = &graph;
+    while (current->GetNodeCount() > coarsestNodesPerPartition * partitionCount)
+    {
+        std::vector<uint32_t> map;
+        PartitionGraph coarse = Coarsen(*current, map);
+        if (coarse.GetNodeCount() > current->GetNodeCount() * minCoarseningRatio)
+            break;
+
+        fineToCoarse.push_back(std::move(map));
+        levels.push_back(std::move(coarse));
+        current = &levels.back();
+    }
+
+    std::vector<int> partitions = GrowPartitions(*current, partitionCount);
+    RefinePartitions(*current, partitions, partitionCount);
+
+    for (int level = int(levels.size()) - 1; level >= 0; level--)
+    {
+        const PartitionGraph& fine = level > 0 ? levels[level - 1] : graph;
+        std::vector<int> finePartitions(fine.GetNodeCount());
+        for (size_t u = 0; u < finePartitions.size(); u++)
+            finePartitions[u] = partitions[fineToCoarse[level][u]];
+
+        partitions = std::move(finePartitions);
+        RefinePartitions(fine, partitions, partitionCount);
+    }
+
+    return partitions;
+}
+
+MeshPartitioning PartitionMesh(VertexArray& vertices, IndexArray& indices, int partitionCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    partitionCount = std::clamp<int>(partitionCount, 1, std::max<size_t>(triangleCount, 1));
+
+    PartitionGraph graph = BuildTriangleGraph(indices, vertices.size());
+    std::vector<int> partitions = PartitionGraphMultilevel(graph, partitionCount);
+
+    MeshPartitioning partitioning;
+    partitioning.partitionCount = partitionCount;
+    for (uint32_t u = 0; u < graph.GetNodeCount(); u++)
+    {
+        for (uint32_t e = graph.offsets[u]; e < graph.offsets[u + 1]; e++)
+            partitioning.edgeCut += partitions[u] != partitions[graph.neighbors[e]];
+    }
+    partitioning.edgeCut /= 2;
+
+    // Stable counting sort keeps the original triangle order inside each partition
+    partitioning.triangleOffsets.assign(partitionCount + 1, 0);
+    for (int partition : partitions)
+        partitioning.triangleOffsets[partition + 1]++;
+    std::partial_sum(partitioning.triangleOffsets.begin(), partitioning.triangleOffsets.end(), partitioning.triangleOffsets.begin());
+
+    std::vector<uint32_t> triangleOrder(triangleCount);
+    std::vector<uint32_t> cursors(partitioning.triangleOffsets.begin(), partitioning.triangleOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++)
+        triangleOrder[cursors[partitions[t]]++] = t;
+
+    // A vertex is interior when all its triangles fall into one partition
+    constexpr int unused = -1;
+    constexpr int boundary = -2;
+    std::vector<int> vertexPartitions(vertices.size(), unused);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+    {
+        int& vertexPartition = vertexPartitions[indices[i]];
+        int partition = partitions[i / 3];
+        vertexPartition = vertexPartition == unused || vertexPartition == partition ? partition : boundary;
+    }
+
+    // Interior vertices are numbered by first use within their partition, boundary and unused ones follow
+    constexpr uint32_t unnumbered = UINT32_MAX;
+    std::vector<uint32_t> newVertexIdxs(vertices.size(), unnumbered);
+    partitioning.vertexOffsets.assign(1, 0);
+    uint32_t nextVertexIdx = 0;
+    for (int p = 0; p < partitionCount; p++)
+    {
+        for (uint32_t i = partitioning.triangleOffsets[p]; i < partitioning.triangleOffsets[p + 1]; i++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                int vertexIdx = indices[triangleOrder[i] * 3 + corner];
+                if (vertexPartitions[vertexIdx] == p && newVertexIdxs[vertexIdx] == unnumbered)
+                    newVertexIdxs[vertexIdx] = nextVertexIdx++;
+            }
+        }
+        partitioning.vertexOffsets.push_back(nextVertexIdx);
+    }
+
+    for (uint32_t i = 0; i < triangleCount; i++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            int vertexIdx = indices[triangleOrder[i] * 3 + corner];
+            if (newVertexIdxs[vertexIdx] == unnumbered)
+                newVertexIdxs[vertexIdx] = nextVertexIdx++;
+        }
+    }
+
+    for (uint32_t& vertexIdx : newVertexIdxs)
+    {
+        if (vertexIdx == unnumbered)
+            vertexIdx = nextVertexIdx++;
+    }
+
+    VertexArray reorderedVertices(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+        reorderedVertices[newVertexIdxs[i]] = vertices[i];
+
+    IndexArray reorderedIndices(triangleCount * 3);
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+        for (int corner = 0; corner < 3; corner++)
+            reorderedIndices[i * 3 + corner] = newVertexIdxs[indices[triangleOrder[i] * 3 + corner]];
+    }
+
+    vertices = std::move(reorderedVertices);
+    indices = std::move(reorderedIndices);
+
+    // Triangles around boundary vertices, gathered in triangle order so sums match a serial pass
+    uint32_t boundaryStart = partitioning.GetBoundaryVertexStart();
+    partitioning.boundaryTriangleOffsets.assign(vertices.size() - boundaryStart + 1, 0);
+    for (int vertexIdx : indices)
+    {
+        if (uint32_t(vertexIdx) >= boundaryStart)
+            partitioning.boundaryTriangleOffsets[vertexIdx - boundaryStart + 1]++;
+    }
+    std::partial_sum(partitioning.boundaryTriangleOffsets.begin(), partitioning.boundaryTriangleOffsets.end(),
+        partitioning.boundaryTriangleOffsets.begin());
+
+    partitioning.boundaryTriangles.resize(partitioning.boundaryTriangleOffsets.back());
+    cursors.assign(partitioning.boundaryTriangleOffsets.begin(), partitioning.boundaryTriangleOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        if (uint32_t(indices[i]) >= boundaryStart)
+            partitioning.boundaryTriangles[cursors[indices[i] - boundaryStart]++] = i / 3;
+    }
+
+    return partitioning;
+}
+
+void CalculatePartitionedNormals(VertexArray& vertices, const IndexArray& indices, const MeshPartitioning& partitioning)
+{
+    uint32_t boundaryStart = partitioning.GetBoundaryVertexStart();
+
+    std::vector<std::future<void>> futures;
+    for (int p = 0; p < partitioning.partitionCount; p++)
+    {
+        futures.emplace_back(std::async(
+            std::launch::async,
+            [&, p]
+            {
+                for (uint32_t i = partitioning.vertexOffsets[p]; i < partitioning.vertexOffsets[p + 1]; i++)
+                    vertices[i].normal = glm::vec3(0);
+
+                // Interior vertices belong to this partition only, boundary ones are left to the second pass
+                for (uint32_t t = partitioning.triangleOffsets[p]; t < partitioning.triangleOffsets[p + 1]; t++)
+                {
+                    const Triangle triangle = Triangle::GetTriangle(vertices, indices, t * 3);
+                    const glm::vec3 normal = triangle.GetNormal();
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        if (uint32_t(indices[t * 3 + corner]) < boundaryStart)
+                            vertices[indices[t * 3 + corner]].normal += normal;
+                    }
+                }
+            }));
+    }
+
+    for (auto& future : futures)
+        future.get();
+
+    size_t boundaryCount = vertices.size() - boundaryStart;
+    size_t threadCount = std::clamp<size_t>(boundaryCount / 4096, 1, std::max(1u, std::thread::hardware_concurrency()));
+    futures.clear();
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        futures.emplace_back(std::async(
+            std::launch::async,
+            [&](size_t start, size_t end)
+            {
+                for (size_t b = start; b < end; b++)
+                {
+                    glm::vec3 normal(0);
+                    for (uint32_t j = partitioning.boundaryTriangleOffsets[b]; j < partitioning.boundaryTriangleOffsets[b + 1]; j++)
+                        normal += Triangle::GetTriangle(vertices, indices, partitioning.boundaryTriangles[j] * 3).GetNormal();
+
+                    vertices[boundaryStart + b].normal = normal;
+                }
+            },
+            i * boundaryCount / threadCount, (i + 1) * boundaryCount / threadCount));
+    }
+
+    for (auto& future : futures)
+        future.get();
+}
+
+void CalculateSerialNormals(VertexArray& vertices, const IndexArray& indices)
+{
+    for (Vertex& vertex : vertices)
+        vertex.normal = glm::vec3(0);
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const Triangle triangle = Triangle::GetTriangle(vertices, indices, i);
+        const glm::vec3 normal = triangle.GetNormal();
+        triangle.vA->normal += normal;
+        triangle.vB->normal += normal;
+        triangle.vC->normal += normal;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+// Partitions are contiguous after PartitionMesh. Vertices used by a single partition come first,
+// grouped by partition, followed by the boundary vertices shared between partitions
+struct MeshPartitioning
+{
+    int partitionCount = 0;
+    std::vector<uint32_t> triangleOffsets;
+    std::vector<uint32_t> vertexOffsets;
+
+    // Triangles around each boundary vertex in ascending order, boundary vertex i is vertexOffsets.back() + i
+    std::vector<uint32_t> boundaryTriangleOffsets;
+    std::vector<uint32_t> boundaryTriangles;
+
+    // Triangle adjacencies that cross partitions
+    size_t edgeCut = 0;
+
+    uint32_t GetBoundaryVertexStart() const { return vertexOffsets.back(); }
+};
+
+// Multilevel partitioning of the triangle adjacency graph: heavy edge matching coarsens the graph,
+// the coarsest one is split by greedy graph growing and the split is refined at every level on the
+// way back. Vertices and indices are reordered in place
+MeshPartitioning PartitionMesh(VertexArray& vertices, IndexArray& indices, int partitionCount);
+
+// Same smooth non-normalized normals as Mesh, one thread per partition scatters into its own interior
+// vertices and a second pass gathers the triangles around boundary vertices
+void CalculatePartitionedNormals(VertexArray& vertices, const IndexArray& indices, const MeshPartitioning& partitioning);
+
+// The same normals from one thread scattering over all triangles in order, the baseline the partitioned pass is timed against
+void CalculateSerialNormals(VertexArray& vertices, const IndexArray& indices);
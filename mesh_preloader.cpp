@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+
+#include "mesh_preloader.h"
+#include "metrics.h"
+
+static MetricsGauge queueDepth("viewer_preloader_queue_depth", "", "Meshes waiting to be preloaded.");
+static MetricsCounter preloadedCount("viewer_preloader_meshes_total", "", "Meshes parsed ahead into the mesh cache.");
+
+MeshPreloader::MeshPreloader(MeshCache& cache)
+    : cache(cache), isLoading(false), isPromoted(false), isStopping(false), isCancelled(false), preloadedBytes(0)
+{
+    thread = std::thread(&MeshPreloader::Run, this);
+}
+
+MeshPreloader::~MeshPreloader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+        isCancelled = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+void MeshPreloader::Request(const std::vector<std::string>& paths)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+    for (const std::string& path : paths)
+    {
+        if (path != currentPath && !cache.Contains(path))
+            pending.push_back(path);
+    }
+    queueDepth.Set(pending.size());
+
+    if (isLoading && !isPromoted && std::find(paths.begin(), paths.end(), currentPath) == paths.end())
+        isCancelled = true;
+
+    condition.notify_all();
+}
+
+void MeshPreloader::Cancel()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+    queueDepth.Set(0);
+    if (!isPromoted)
+        isCancelled = true;
+}
+
+void MeshPreloader::Promote(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!isLoading || currentPath != path || isCancelled)
+        return;
+
+    isPromoted = true;
+    RaisePriority();
+}
+
+std::unique_ptr<Mesh> MeshPreloader::TakePromoted(const std::string& path)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!isPromoted || currentPath != path)
+        return nullptr;
+
+    condition.wait(lock, [this] { return !isLoading; });
+    isPromoted = false;
+    currentPath.clear();
+    ForgetPreloaded(path);
+    return std::move(promotedMesh);
+}
+
+std::unique_ptr<Mesh> MeshPreloader::Take(const std::string& path)
+{
+    // Forgetting and taking under one lock keeps Run from recording the mesh as preloaded in between
+    std::lock_guard<std::mutex> lock(mutex);
+    ForgetPreloaded(path);
+    return cache.Take(path);
+}
+
+void MeshPreloader::ForgetPreloaded(const std::string& path)
+{
+    auto entry = std::find_if(preloaded.begin(), preloaded.end(), [&path](const auto& preloadedEntry) { return preloadedEntry.first == path; });
+    if (entry != preloaded.end())
+    {
+        preloadedBytes -= entry->second;
+        preloaded.erase(entry);
+    }
+}
+
+void MeshPreloader::Run()
+{
+#ifdef __APPLE__
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+
+    while (true)
+    {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return isStopping || (!pending.empty() && !isPromoted); });
+            if (isStopping)
+                return;
+
+            path = pending.front();
+            pending.pop_front();
+            queueDepth.Set(pending.size());
+            currentPath = path;
+            isLoading = true;
+            isCancelled = false;
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        std::unique_ptr<Mesh> mesh = Mesh::TryLoad(path.c_str(), &isCancelled);
+        auto parseTime = std::chrono::steady_clock::now() - startTime;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        isLoading = false;
+        if (isPromoted)
+        {
+#ifdef __APPLE__
+            pthread_override_qos_class_end_np(priorityOverride);
+#endif
+            // TakePromoted hands the mesh over and clears the current path
+            promotedMesh = std::move(mesh);
+            condition.notify_all();
+            continue;
+        }
+
+        currentPath.clear();
+        if (!mesh)
+            continue;
+
+        preloadedCount.Add();
+
+        // Meshes the cache dropped over its own budget no longer count against the preloader's
+        std::erase_if(preloaded, [this](const auto& preloadedEntry) { return !cache.Contains(preloadedEntry.first); });
+        preloadedBytes = 0;
+        for (const auto& preloadedEntry : preloaded)
+            preloadedBytes += preloadedEntry.second;
+
+        // Only meshes nobody took since they were preloaded are dropped. Removing them under the lock
+        // keeps Take from handing one to the viewer and getting it put back in between
+        size_t bytes = mesh->vertexCount * sizeof(Vertex) + mesh->indexCount * sizeof(int);
+        while (preloadedBytes + bytes > settings.memoryBudget && !preloaded.empty())
+        {
+            cache.Remove(preloaded.front().first);
+            preloadedBytes -= preloaded.front().second;
+            preloaded.pop_front();
+        }
+
+        // The mesh is put in the cache before it is recorded, outside the lock since Put may compress older
+        // entries. A Take in between finds it and it is not recorded, as Take holds the lock while taking
+        lock.unlock();
+        cache.Put(std::move(mesh));
+        lock.lock();
+        if (cache.Contains(path))
+        {
+            preloaded.emplace_back(path, bytes);
+            preloadedBytes += bytes;
+        }
+
+#ifndef __APPLE__
+        // Rests so parsing takes at most busyFraction of the time, pending requests wait for it to end
+        float busyFraction = std::clamp(settings.busyFraction, 0.01f, 1.0f);
+        auto restTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(parseTime * ((1 - busyFraction) / busyFraction));
+        condition.wait_for(lock, restTime, [this] { return isStopping; });
+#endif
+    }
+}
+
+void MeshPreloader::RaisePriority()
+{
+#ifdef __APPLE__
+    priorityOverride = pthread_override_qos_class_start_np(thread.native_handle(), QOS_CLASS_USER_INITIATED, 0);
+#endif
+    // Elsewhere parses already run at normal priority
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mesh.h"
+#include "mesh_cache.h"
+
+struct MeshPreloaderSettings
+{
+    // Preloaded meshes that were not picked are dropped from the cache beyond this size
+    size_t memoryBudget = 256 * 1024 * 1024;
+    int neighborCount = 1;
+
+    // Outside macOS the thread keeps normal priority, since a lowered nice value cannot be raised again
+    // without privileges once a parse is promoted. It rests after each preload instead, so preloading
+    // takes at most this share of a core
+    float busyFraction = 0.5f;
+};
+
+// Parses meshes the user is likely to pick next into the mesh cache in the background, on a low priority
+// thread on macOS and throttled between parses elsewhere
+class MeshPreloader
+{
+public:
+    MeshPreloaderSettings settings;
+
+    MeshPreloader(MeshCache& cache);
+    ~MeshPreloader();
+
+    // Replaces the pending requests, the running parse is cancelled unless it is still requested
+    void Request(const std::vector<std::string>& paths);
+
+    // Drops pending requests and cancels the running parse unless it was promoted
+    void Cancel();
+
+    // Marks a running parse of the path as wanted now, raises its priority on macOS and skips the rest after it
+    void Promote(const std::string& path);
+
+    // Waits for the promoted parse of the path, returns nullptr if the path was not being parsed
+    std::unique_ptr<Mesh> TakePromoted(const std::string& path);
+
+    // Takes the mesh for the path from the cache. Once taken it belongs to the caller, so the
+    // preloader no longer counts it against its budget or drops it when it is put back
+    std::unique_ptr<Mesh> Take(const std::string& path);
+
+private:
+    MeshCache& cache;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::string> pending;
+    std::string currentPath;
+    bool isLoading;
+    bool isPromoted;
+    bool isStopping;
+    std::atomic<bool> isCancelled;
+    std::unique_ptr<Mesh> promotedMesh;
+
+    // Meshes put in the cache by the preloader and not taken since, oldest first
+    std::deque<std::pair<std::string, size_t>> preloaded;
+    size_t preloadedBytes;
+
+    std::thread thread;
+#ifdef __APPLE__
+    pthread_override_t priorityOverride;
+#endif
+
+    void Run();
+    void RaisePriority();
+    void ForgetPreloaded(const std::string& path);
+};
@@ -0,0 +1,341 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mesh_sequence.h"
+
+static uint64_t GetFrameOffset(const MeshSequenceHeader& header, uint32_t frame)
+{
+    return sizeof(MeshSequenceHeader) + header.indexCount * sizeof(uint32_t) + uint64_t(frame) * header.vertexCount * sizeof(glm::vec3);
+}
+
+// Splits [0, count) into one range per thread
+template<typename Function>
+static void ForEachRangeParallel(size_t count, Function function)
+{
+    size_t threadCount = std::clamp<size_t>(count / 4096, 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < threadCount; i++)
+        futures.emplace_back(std::async(std::launch::async, function, i * count / threadCount, (i + 1) * count / threadCount));
+
+    for (auto& future : futures)
+        future.get();
+}
+
+bool WriteMeshSequence(const std::vector<std::string>& framePaths, const char* path, float frameRate)
+{
+    if (framePaths.empty())
+        return false;
+
+    std::unique_ptr<Mesh> firstMesh = Mesh::TryLoad(framePaths[0].c_str());
+    if (!firstMesh)
+        return false;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open output file" << std::endl;
+        return false;
+    }
+
+    MeshSequenceHeader header = {};
+    memcpy(header.magic, "MSEQ", 4);
+    header.version = meshSequenceVersion;
+    header.vertexCount = firstMesh->vertexCount;
+    header.indexCount = firstMesh->indexCount;
+    header.frameCount = framePaths.size();
+    header.frameRate = frameRate;
+
+    bool didWrite = fwrite(&header, sizeof(header), 1, file) == 1;
+    didWrite = didWrite && fwrite(firstMesh->indices.data(), sizeof(uint32_t), header.indexCount, file) == header.indexCount;
+
+    std::vector<glm::vec3> positions(header.vertexCount);
+    for (size_t i = 0; i < framePaths.size() && didWrite; i++)
+    {
+        std::unique_ptr<Mesh> mesh = i == 0 ? std::move(firstMesh) : Mesh::TryLoad(framePaths[i].c_str());
+        if (!mesh)
+        {
+            didWrite = false;
+            break;
+        }
+
+        if (mesh->vertexCount != header.vertexCount || mesh->indexCount != header.indexCount || (i > 0 && mesh->topologyHash != firstMesh->topologyHash))
+        {
+            std::cerr << "Topology of " << framePaths[i] << " differs from the first frame" << std::endl;
+            didWrite = false;
+            break;
+        }
+
+        for (size_t j = 0; j < positions.size(); j++)
+            positions[j] = mesh->vertices[j].position;
+
+        didWrite = fwrite(positions.data(), sizeof(glm::vec3), positions.size(), file) == positions.size();
+
+        // The first mesh stays around for the topology check
+        if (i == 0)
+            firstMesh = std::move(mesh);
+    }
+
+    fclose(file);
+    return didWrite;
+}
+
+MeshSequencePlayer::MeshSequencePlayer(const char* path)
+    : isPlaying(true), droppedFrameCount(0), frontBuffer(0), currentFrame(0), hasUploadedFrame(false), time(0), targetFrame(0),
+      isStopping(false)
+{
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+
+    // Counts are checked against the file size before the offsets are added up, and the triangle list must be whole
+    // since every index is mapped to the triangle i / 3 it belongs to
+    struct stat fileStat;
+    bool isValid = fstat(fd, &fileStat) == 0 && pread(fd, &header, sizeof(header), 0) == sizeof(header)
+                   && memcmp(header.magic, "MSEQ", 4) == 0 && header.version == meshSequenceVersion && header.frameCount > 0
+                   && header.frameRate > 0 && header.indexCount % 3 == 0
+                   && header.indexCount <= uint64_t(fileStat.st_size) / sizeof(uint32_t)
+                   && header.vertexCount <= uint64_t(fileStat.st_size) / sizeof(glm::vec3) / header.frameCount
+                   && GetFrameOffset(header, header.frameCount) <= uint64_t(fileStat.st_size);
+    if (!isValid)
+    {
+        std::cerr << "Invalid mesh sequence format" << std::endl;
+        exit(1);
+    }
+
+    indices.resize(header.indexCount);
+    size_t indicesSize = indices.size() * sizeof(uint32_t);
+    if (pread(fd, indices.data(), indicesSize, sizeof(header)) != ssize_t(indicesSize))
+    {
+        std::cerr << "Failed to read mesh sequence indices" << std::endl;
+        exit(1);
+    }
+
+    if (std::any_of(indices.begin(), indices.end(), [this](uint32_t index) { return index >= header.vertexCount; }))
+    {
+        std::cerr << "Invalid index format" << std::endl;
+        exit(1);
+    }
+
+    // Compressed lists of the triangles around each vertex, so normals can be gathered per vertex without write conflicts
+    vertexTriangleOffsets.assign(header.vertexCount + 1, 0);
+    for (uint32_t index : indices)
+        vertexTriangleOffsets[index + 1]++;
+    for (size_t i = 0; i < header.vertexCount; i++)
+        vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+
+    vertexTriangles.resize(indices.size());
+    std::vector<uint32_t> fillCounts(header.vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++)
+        vertexTriangles[vertexTriangleOffsets[indices[i]] + fillCounts[indices[i]]++] = i / 3;
+
+    // Two vertex buffers sharing one index buffer
+    glGenVertexArrays(2, vaos);
+    glGenBuffers(2, vbos);
+    glGenBuffers(1, &ibo);
+    for (int i = 0; i < 2; i++)
+    {
+        glBindVertexArray(vaos[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[i]);
+        glBufferData(GL_ARRAY_BUFFER, header.vertexCount * sizeof(Vertex), nullptr, GL_STREAM_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), nullptr);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        if (i == 0)
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    prefetchThread = std::thread(&MeshSequencePlayer::RunPrefetch, this);
+}
+
+MeshSequencePlayer::~MeshSequencePlayer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    condition.notify_all();
+    prefetchThread.join();
+
+    glDeleteVertexArrays(2, vaos);
+    glDeleteBuffers(2, vbos);
+    glDeleteBuffers(1, &ibo);
+    close(fd);
+}
+
+uint32_t MeshSequencePlayer::GetFrameDistance(uint32_t from, uint32_t to) const
+{
+    return (to + header.frameCount - from) % header.frameCount;
+}
+
+void MeshSequencePlayer::Update(float deltaTime)
+{
+    if (isPlaying)
+        time += deltaTime;
+
+    uint32_t dueFrame = uint64_t(time * header.frameRate) % header.frameCount;
+
+    PreparedFrame readyFrame;
+    bool isFrameReady = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        targetFrame = dueFrame;
+
+        while (!preparedFrames.empty())
+        {
+            uint32_t distance = GetFrameDistance(dueFrame, preparedFrames.front().frame);
+            if (distance == 0)
+            {
+                readyFrame = std::move(preparedFrames.front());
+                preparedFrames.pop_front();
+                isFrameReady = true;
+                break;
+            }
+
+            // Frames ahead of playback wait, frames behind it are dropped
+            if (distance <= header.frameCount / 2)
+                break;
+
+            freeVertexArrays.push_back(std::move(preparedFrames.front().vertices));
+            preparedFrames.pop_front();
+            droppedFrameCount++;
+        }
+    }
+    condition.notify_all();
+
+    if (!isFrameReady)
+        return;
+
+    if (!hasUploadedFrame || readyFrame.frame != currentFrame)
+    {
+        // Write into the buffer that was not drawn last frame
+        int backBuffer = 1 - frontBuffer;
+        glBindBuffer(GL_ARRAY_BUFFER, vbos[backBuffer]);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, readyFrame.vertices.size() * sizeof(Vertex), readyFrame.vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        frontBuffer = backBuffer;
+        currentFrame = readyFrame.frame;
+        hasUploadedFrame = true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    freeVertexArrays.push_back(std::move(readyFrame.vertices));
+}
+
+void MeshSequencePlayer::Draw()
+{
+    if (!hasUploadedFrame)
+        return;
+
+    glBindVertexArray(vaos[frontBuffer]);
+    glDrawElements(GL_TRIANGLES, header.indexCount, GL_UNSIGNED_INT, nullptr);
+}
+
+void MeshSequencePlayer::RunPrefetch()
+{
+    std::vector<glm::vec3> positions(header.vertexCount);
+    std::vector<glm::vec3> triangleNormals(header.indexCount / 3);
+    uint32_t frame = 0;
+
+    while (true)
+    {
+        std::vector<Vertex> vertices;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return isStopping || preparedFrames.size() < maxPreparedFrameCount; });
+            if (isStopping)
+                return;
+
+            // Continue from the playback position when it overtook the prefetch
+            if (GetFrameDistance(targetFrame, frame) > header.frameCount / 2)
+                frame = targetFrame;
+
+            if (!freeVertexArrays.empty())
+            {
+                vertices = std::move(freeVertexArrays.back());
+                freeVertexArrays.pop_back();
+            }
+        }
+
+        if (!PrepareFrame(frame, positions, triangleNormals, vertices))
+        {
+            std::cerr << "Failed to read sequence frame " << frame << std::endl;
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            preparedFrames.push_back({frame, std::move(vertices)});
+        }
+
+        // A single frame never changes
+        if (header.frameCount == 1)
+            return;
+
+        frame = (frame + 1) % header.frameCount;
+    }
+}
+
+bool MeshSequencePlayer::PrepareFrame(uint32_t frame, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& triangleNormals,
+    std::vector<Vertex>& vertices)
+{
+    size_t size = positions.size() * sizeof(glm::vec3);
+    char* data = reinterpret_cast<char*>(positions.data());
+    uint64_t offset = GetFrameOffset(header, frame);
+    for (size_t readSize = 0; readSize < size;)
+    {
+        ssize_t readCount = pread(fd, data + readSize, size - readSize, offset + readSize);
+        if (readCount <= 0)
+            return false;
+        readSize += readCount;
+    }
+
+    ForEachRangeParallel(
+        triangleNormals.size(),
+        [&](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; i++)
+            {
+                const glm::vec3& a = positions[indices[i * 3]];
+                triangleNormals[i] = glm::cross(positions[indices[i * 3 + 1]] - a, positions[indices[i * 3 + 2]] - a);
+            }
+        });
+
+    // Same smooth non-normalized normals as Mesh::CalculateNormals
+    vertices.resize(positions.size());
+    ForEachRangeParallel(
+        vertices.size(),
+        [&](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; i++)
+            {
+                glm::vec3 normal(0);
+                for (uint32_t j = vertexTriangleOffsets[i]; j < vertexTriangleOffsets[i + 1]; j++)
+                    normal += triangleNormals[vertexTriangles[j]];
+
+                vertices[i].position = positions[i];
+                vertices[i].normal = normal;
+            }
+        });
+
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#include <OpenGL/gl3ext.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+
+// Mesh sequence layout:
+// header | indices (uint32, shared by all frames) | per frame: positions (vec3)
+// Normals are not stored, they are calculated per frame during playback
+constexpr uint32_t meshSequenceVersion = 1;
+
+struct MeshSequenceHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint32_t frameCount;
+    float frameRate;
+};
+
+// Combines mesh files with the same triangles into one sequence, fails on files with a different topology
+bool WriteMeshSequence(const std::vector<std::string>& framePaths, const char* path, float frameRate = 30.0f);
+
+// Plays a sequence in a loop. A prefetch thread reads positions and calculates normals in parallel
+// a few frames ahead, and frames are uploaded alternately into two vertex buffers so the
+// upload never waits on the buffer being drawn
+class MeshSequencePlayer
+{
+public:
+    bool isPlaying;
+    int droppedFrameCount;
+
+    MeshSequencePlayer(const char* path);
+    ~MeshSequencePlayer();
+
+    // Advances playback and uploads the frame due, if it is prepared
+    void Update(float deltaTime);
+    void Draw();
+
+    uint32_t GetFrameCount() const { return header.frameCount; }
+    uint32_t GetCurrentFrame() const { return currentFrame; }
+    const MeshSequenceHeader& GetHeader() const { return header; }
+
+private:
+    struct PreparedFrame
+    {
+        uint32_t frame;
+        std::vector<Vertex> vertices;
+    };
+
+    static constexpr size_t maxPreparedFrameCount = 3;
+
+    int fd;
+    MeshSequenceHeader header;
+    std::vector<uint32_t> indices;
+
+    // Triangles around each vertex, fixed for the whole sequence
+    std::vector<uint32_t> vertexTriangleOffsets;
+    std::vector<uint32_t> vertexTriangles;
+
+    uint vaos[2];
+    uint vbos[2];
+    uint ibo;
+    int frontBuffer;
+    uint32_t currentFrame;
+    bool hasUploadedFrame;
+    double time;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<PreparedFrame> preparedFrames;
+    std::vector<std::vector<Vertex>> freeVertexArrays;
+    uint32_t targetFrame;
+    bool isStopping;
+    std::thread prefetchThread;
+
+    void RunPrefetch();
+    bool PrepareFrame(uint32_t frame, std::vector<glm::vec3>& positions, std::vector<glm::vec3>& triangleNormals, std::vector<Vertex>& vertices);
+    uint32_t GetFrameDistance(uint32_t from, uint32_t to) const;
+};
@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+#include "allocation_tracker.h"
+#include "metrics.h"
+
+// Quantiles written for each histogram, read from its fine buckets
+constexpr double histogramQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+// Cumulative buckets are exposed at 2^k microseconds for these k, 16 us to about 33 s
+constexpr int firstBoundShift = 4;
+constexpr int lastBoundShift = 25;
+
+MetricsSettings metricsSettings;
+
+// Constant initialized, metrics register during static initialization from any file
+static Metric* firstMetric = nullptr;
+
+static int listenFd = -1;
+static std::thread serverThread;
+static std::atomic<bool> isServerStopping = false;
+
+Metric::Metric(const char* name, const char* labels, const char* help, const char* type)
+    : name(name), labels(labels), help(help), type(type), next(firstMetric)
+{
+    firstMetric = this;
+}
+
+static void AppendSample(std::string& out, const char* name, const char* suffix, const char* labels, const char* extraLabel, double value)
+{
+    char line[256];
+    bool hasLabels = labels[0] != '\0';
+    bool hasExtraLabel = extraLabel[0] != '\0';
+    snprintf(line, sizeof(line), "%s%s%s%s%s%s%s %.15g\n", name, suffix, hasLabels || hasExtraLabel ? "{" : "", labels,
+        hasLabels && hasExtraLabel ? "," : "", extraLabel, hasLabels || hasExtraLabel ? "}" : "", value);
+    out += line;
+}
+
+MetricsCounter::MetricsCounter(const char* name, const char* labels, const char* help)
+    : Metric(name, labels, help, "counter")
+{
+}
+
+void MetricsCounter::Write(std::string& out) const
+{
+    AppendSample(out, name, "", labels, "", double(value.load(std::memory_order_relaxed)));
+}
+
+MetricsGauge::MetricsGauge(const char* name, const char* labels, const char* help)
+    : Metric(name, labels, help, "gauge")
+{
+}
+
+void MetricsGauge::Write(std::string& out) const
+{
+    AppendSample(out, name, "", labels, "", value.load(std::memory_order_relaxed));
+}
+
+LatencyHistogram::LatencyHistogram(const char* name, const char* labels, const char* help)
+    : Metric(name, labels, help, "histogram")
+{
+}
+
+uint64_t LatencyHistogram::LoadCounts(uint64_t* counts) const
+{
+    uint64_t totalCount = 0;
+    for (int i = 0; i < bucketCount; i++)
+    {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        totalCount += counts[i];
+    }
+
+    return totalCount;
+}
+
+void LatencyHistogram::Write(std::string& out) const
+{
+    // One snapshot of the buckets, so the count always equals the +Inf bucket
+    uint64_t counts[bucketCount];
+    uint64_t totalCount = LoadCounts(counts);
+
+    char bound[64];
+    uint64_t cumulativeCount = 0;
+    int bucket = 0;
+    for (int shift = firstBoundShift; shift <= lastBoundShift; shift++)
+    {
+        while (bucket < bucketCount && GetBucketEnd(bucket) <= (uint64_t(1) << shift))
+            cumulativeCount += counts[bucket++];
+
+        snprintf(bound, sizeof(bound), "le=\"%.15g\"", double(uint64_t(1) << shift) / 1e6);
+        AppendSample(out, name, "_bucket", labels, bound, double(cumulativeCount));
+    }
+
+    AppendSample(out, name, "_bucket", labels, "le=\"+Inf\"", double(totalCount));
+    AppendSample(out, name, "_sum", labels, "", sumMicroseconds.load(std::memory_order_relaxed) / 1e6);
+    AppendSample(out, name, "_count", labels, "", double(totalCount));
+}
+
+void LatencyHistogram::WriteQuantiles(std::string& out) const
+{
+    uint64_t counts[bucketCount];
+    uint64_t totalCount = LoadCounts(counts);
+
+    // Quantiles since start, reported as the upper end of the bucket they fall into
+    for (double quantile : histogramQuantiles)
+    {
+        uint64_t rank = uint64_t(quantile * totalCount);
+        uint64_t seenCount = 0;
+        double seconds = 0;
+        for (int i = 0; i < bucketCount && totalCount > 0; i++)
+        {
+            seenCount += counts[i];
+            if (seenCount > rank)
+            {
+                seconds = GetBucketEnd(i) / 1e6;
+                break;
+            }
+        }
+
+        char label[64];
+        snprintf(label, sizeof(label), "quantile=\"%.15g\"", quantile);
+        AppendSample(out, name, "_quantile", labels, label, seconds);
+    }
+}
+
+static uint64_t GetResidentBytes()
+{
+#ifdef __APPLE__
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#else
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+
+    unsigned long long pageCount = 0;
+    unsigned long long residentPageCount = 0;
+    int readCount = fscanf(file, "%llu %llu", &pageCount, &residentPageCount);
+    fclose(file);
+    return readCount == 2 ? residentPageCount * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+static void AppendFamily(std::string& out, const char* name, const char* help, const char* type)
+{
+    out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+std::string WriteMetrics()
+{
+    std::vector<const Metric*> metrics;
+    for (const Metric* metric = firstMetric; metric; metric = metric->next)
+        metrics.push_back(metric);
+
+    // Families are written together, registration order between files is unspecified
+    std::stable_sort(metrics.begin(), metrics.end(), [](const Metric* a, const Metric* b) { return strcmp(a->name, b->name) < 0; });
+
+    std::string out;
+    for (size_t start = 0, end = 0; start < metrics.size(); start = end)
+    {
+        while (end < metrics.size() && strcmp(metrics[start]->name, metrics[end]->name) == 0)
+            end++;
+
+        // Only one member of a family needs to carry the help text
+        const char* help = "";
+        for (size_t i = start; i < end && help[0] == '\0'; i++)
+            help = metrics[i]->help;
+
+        AppendFamily(out, metrics[start]->name, help, metrics[start]->type);
+        for (size_t i = start; i < end; i++)
+            metrics[i]->Write(out);
+
+        // Prometheus computes windowed quantiles from the buckets, these cover the whole run at the finer resolution
+        if (strcmp(metrics[start]->type, "histogram") == 0)
+        {
+            std::string quantileName = std::string(metrics[start]->name) + "_quantile";
+            AppendFamily(out, quantileName.c_str(), help, "gauge");
+            for (size_t i = start; i < end; i++)
+                static_cast<const LatencyHistogram*>(metrics[i])->WriteQuantiles(out);
+        }
+    }
+
+    AppendFamily(out, "process_resident_memory_bytes", "Resident memory size in bytes.", "gauge");
+    AppendSample(out, "process_resident_memory_bytes", "", "", "", double(GetResidentBytes()));
+
+    // Only the allocations build counts allocations
+    if (isAllocationTrackingEnabled)
+    {
+        AppendFamily(out, "viewer_allocations_total", "Heap allocations made.", "counter");
+        AppendSample(out, "viewer_allocations_total", "", "", "", double(GetAllocationCount()));
+        AppendFamily(out, "viewer_allocated_bytes_total", "Bytes allocated on the heap.", "counter");
+        AppendSample(out, "viewer_allocated_bytes_total", "", "", "", double(GetAllocatedBytes()));
+
+        std::vector<AllocationScopeStats> scopes = GetAllocationScopeStats();
+        AppendFamily(out, "viewer_allocation_live_bytes", "Heap bytes currently allocated per allocation scope.", "gauge");
+        for (const AllocationScopeStats& scope : scopes)
+            AppendSample(out, "viewer_allocation_live_bytes", "", "", ("scope=\"" + std::string(scope.name) + "\"").c_str(), double(scope.liveBytes));
+        AppendFamily(out, "viewer_allocation_peak_bytes", "Highest heap bytes allocated at once per allocation scope.", "gauge");
+        for (const AllocationScopeStats& scope : scopes)
+            AppendSample(out, "viewer_allocation_peak_bytes", "", "", ("scope=\"" + std::string(scope.name) + "\"").c_str(), double(scope.peakBytes));
+    }
+
+    return out;
+}
+
+static void SendAll(int fd, const std::string& data)
+{
+#ifdef MSG_NOSIGNAL
+    constexpr int sendFlags = MSG_NOSIGNAL;
+#else
+    constexpr int sendFlags = 0;
+#endif
+
+    size_t sentCount = 0;
+    while (sentCount < data.size())
+    {
+        ssize_t count = send(fd, data.data() + sentCount, data.size() - sentCount, sendFlags);
+        if (count <= 0)
+            return;
+        sentCount += count;
+    }
+}
+
+static void ServeClient(int clientFd)
+{
+    // A scraper that stalls cannot hold the endpoint for long
+    timeval timeout = { 1, 0 };
+    setsockopt(clientFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(clientFd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+    // Only the request line matters, headers are read up to their end and ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+    {
+        ssize_t count = recv(clientFd, buffer, sizeof(buffer), 0);
+        if (count <= 0)
+            break;
+        request.append(buffer, count);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 4, "GET ") != 0)
+        status = "405 Method Not Allowed";
+    else if (request.compare(4, 9, "/metrics ") != 0 && request.compare(4, 9, "/metrics?") != 0)
+        status = "404 Not Found";
+    else
+        body = WriteMetrics();
+
+    SendAll(clientFd, "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size())
+                          + "\r\nConnection: close\r\n\r\n" + body);
+    close(clientFd);
+}
+
+// Scrapes are served one at a time, each takes well under a millisecond
+static void RunMetricsServer()
+{
+    while (!isServerStopping.load())
+    {
+        // Wakes up regularly to notice StopMetricsServer
+        pollfd listenPoll = { listenFd, POLLIN, 0 };
+        if (poll(&listenPoll, 1, 100) <= 0)
+            continue;
+
+        int clientFd = accept(listenFd, nullptr, nullptr);
+        if (clientFd >= 0)
+            ServeClient(clientFd);
+    }
+}
+
+bool StartMetricsServer(int port)
+{
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0)
+    {
+        std::cerr << "Failed to create the metrics socket" << std::endl;
+        return false;
+    }
+
+    int reuseAddress = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 8) != 0)
+    {
+        std::cerr << "Failed to listen for metrics on 127.0.0.1:" << port << ": " << strerror(errno) << std::endl;
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    metricsSettings.isEnabled = true;
+    isServerStopping = false;
+    serverThread = std::thread(RunMetricsServer);
+
+    // Commands that end with exit skip StopMetricsServer, the thread still has to be joined before
+    // static destructors run or the joinable std::thread terminates the process
+    static bool isStopRegistered = false;
+    if (!isStopRegistered)
+        isStopRegistered = atexit(StopMetricsServer) == 0;
+    return true;
+}
+
+void StopMetricsServer()
+{
+    if (listenFd < 0)
+        return;
+
+    isServerStopping = true;
+    serverThread.join();
+    close(listenFd);
+    listenFd = -1;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+struct MetricsSettings
+{
+    // Set once the endpoint is listening, recording is a single branch while it is off
+    bool isEnabled = false;
+};
+
+extern MetricsSettings metricsSettings;
+
+// Metrics are static objects that link themselves into a list when constructed, so modules declare
+// their own and the endpoint finds them without a central table. Values are relaxed atomics,
+// recording never takes a lock and scrapes read whatever the writers have published so far
+class Metric
+{
+public:
+    // Labels are written as is between the braces, like tier="raw". Metrics sharing a name form one family
+    Metric(const char* name, const char* labels, const char* help, const char* type);
+    virtual ~Metric() = default;
+
+    Metric(const Metric&) = delete;
+    Metric& operator=(const Metric&) = delete;
+
+    const char* name;
+    const char* labels;
+    const char* help;
+    const char* type;
+    Metric* next;
+
+    virtual void Write(std::string& out) const = 0;
+};
+
+class MetricsCounter : public Metric
+{
+public:
+    MetricsCounter(const char* name, const char* labels, const char* help);
+
+    void Add(uint64_t amount = 1)
+    {
+        if (metricsSettings.isEnabled)
+            value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void Write(std::string& out) const override;
+
+private:
+    std::atomic<uint64_t> value = 0;
+};
+
+class MetricsGauge : public Metric
+{
+public:
+    MetricsGauge(const char* name, const char* labels, const char* help);
+
+    void Set(double newValue)
+    {
+        if (metricsSettings.isEnabled)
+            value.store(newValue, std::memory_order_relaxed);
+    }
+
+    void Write(std::string& out) const override;
+
+private:
+    std::atomic<double> value = 0;
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: every power of two of microseconds is split
+// into 8 buckets, so any recorded value is known within 12.5%. Scrapes expose cumulative buckets at
+// each power of two and quantiles read from the fine buckets
+class LatencyHistogram : public Metric
+{
+public:
+    static constexpr int subBucketBits = 3;
+    static constexpr int subBucketCount = 1 << subBucketBits;
+
+    // Up to 2^34 microseconds, about 4.7 hours, longer values land in the last bucket
+    static constexpr int bucketCount = 32 * subBucketCount;
+
+    LatencyHistogram(const char* name, const char* labels, const char* help);
+
+    void Record(double seconds)
+    {
+        if (!metricsSettings.isEnabled)
+            return;
+
+        uint64_t microseconds = seconds > 0 ? uint64_t(seconds * 1e6 + 0.5) : 0;
+        buckets[GetBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+        sumMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+    }
+
+    void Write(std::string& out) const override;
+    void WriteQuantiles(std::string& out) const;
+
+private:
+    std::atomic<uint64_t> buckets[bucketCount] = {};
+    std::atomic<uint64_t> sumMicroseconds = 0;
+
+    // Copies the buckets and returns their total
+    uint64_t LoadCounts(uint64_t* counts) const;
+
+    static int GetBucket(uint64_t microseconds)
+    {
+        if (microseconds < subBucketCount)
+            return int(microseconds);
+
+        int shift = 63 - __builtin_clzll(microseconds) - subBucketBits;
+        int bucket = (shift + 1) * subBucketCount + int(microseconds >> shift) - subBucketCount;
+        return bucket < bucketCount ? bucket : bucketCount - 1;
+    }
+
+    // Exclusive upper bound of the bucket in microseconds
+    static uint64_t GetBucketEnd(int bucket)
+    {
+        if (bucket < subBucketCount)
+            return bucket + 1;
+
+        int shift = bucket / subBucketCount - 1;
+        return uint64_t(subBucketCount + bucket % subBucketCount + 1) << shift;
+    }
+};
+
+// Serves all metrics in the Prometheus text format on http://127.0.0.1:<port>/metrics from a background
+// thread. Only the loopback interface is bound, so the endpoint is not reachable from other machines
+bool StartMetricsServer(int port);
+void StopMetricsServer();
+
+// The exposition text the endpoint returns, also including process memory and the allocation tracker totals
+std::string WriteMetrics();
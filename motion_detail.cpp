@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <array>
+
+#include "motion_detail.h"
+
+// Weight of the newest frame in the smoothed frame time
+constexpr float frameTimeSmoothing = 0.3f;
+
+// Keeps the dense cell table at 8 MB at most
+constexpr int maxCoarseResolution = 128;
+
+MotionDetail::MotionDetail()
+    : level(motionDetailFull), smoothedFrameMs(0), framesAtLevel(0)
+{
+}
+
+MotionDetailLevel MotionDetail::Update(bool isCameraMoving, float frameMs, bool isNormalRendering, bool hasCoarseRepresentation)
+{
+    smoothedFrameMs = smoothedFrameMs > 0 ? smoothedFrameMs + (frameMs - smoothedFrameMs) * frameTimeSmoothing : frameMs;
+    framesAtLevel++;
+
+    MotionDetailLevel maxLevel = hasCoarseRepresentation ? motionDetailCoarse : (isNormalRendering ? motionDetailNoNormals : motionDetailFull);
+    if (!settings.isEnabled)
+        maxLevel = motionDetailFull;
+
+    if (isCameraMoving && level < maxLevel && framesAtLevel > settings.settleFrameCount
+        && smoothedFrameMs > settings.targetFrameMs * settings.degradeRatio)
+    {
+        level = MotionDetailLevel(level + 1);
+        if (level == motionDetailNoNormals && !isNormalRendering)
+            level = motionDetailCoarse;
+
+        // The frames so far were drawn at the previous level and say little about this one
+        framesAtLevel = 0;
+        smoothedFrameMs = 0;
+    }
+    else if (level > maxLevel || (!isCameraMoving && level > motionDetailFull && framesAtLevel > settings.restoreFrameCount))
+    {
+        level = MotionDetailLevel(std::min(level - 1, int(maxLevel)));
+        if (level == motionDetailNoNormals && !isNormalRendering)
+            level = motionDetailFull;
+
+        framesAtLevel = 0;
+        smoothedFrameMs = 0;
+    }
+
+    return level;
+}
+
+std::vector<uint32_t> BuildCoarseIndices(const VertexArray& vertices, const IndexArray& indices, const Bounds& bounds, int resolution)
+{
+    resolution = std::clamp(resolution, 2, maxCoarseResolution);
+    const glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+
+    // The first vertex found in a cell stands in for all of them
+    std::vector<uint32_t> cellVertexIdxs(size_t(resolution) * resolution * resolution, UINT32_MAX);
+    std::vector<uint32_t> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const glm::ivec3 cell = glm::clamp(glm::ivec3((vertices[i].position - bounds.min) / extent * float(resolution)), 0, resolution - 1);
+        uint32_t& cellVertexIdx = cellVertexIdxs[(size_t(cell.x) * resolution + cell.y) * resolution + cell.z];
+        if (cellVertexIdx == UINT32_MAX)
+            cellVertexIdx = i;
+        remap[i] = cellVertexIdx;
+    }
+
+    // Neighboring triangles often collapse onto the same cells. Each triangle is rotated to start at its
+    // smallest index, keeping its winding, so the copies compare equal and are drawn once
+    std::vector<std::array<uint32_t, 3>> coarseTriangles;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        std::array<uint32_t, 3> triangle = { remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]] };
+        if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+            continue;
+
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        coarseTriangles.push_back(triangle);
+    }
+
+    std::sort(coarseTriangles.begin(), coarseTriangles.end());
+    coarseTriangles.erase(std::unique(coarseTriangles.begin(), coarseTriangles.end()), coarseTriangles.end());
+
+    std::vector<uint32_t> coarseIndices;
+    coarseIndices.reserve(coarseTriangles.size() * 3);
+    for (const std::array<uint32_t, 3>& triangle : coarseTriangles)
+        coarseIndices.insert(coarseIndices.end(), triangle.begin(), triangle.end());
+
+    return coarseIndices;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+struct MotionDetailSettings
+{
+    bool isEnabled = true;
+
+    // Frame time kept while the camera moves, detail is lowered one level when the smoothed
+    // frame time exceeds it by degradeRatio
+    float targetFrameMs = 1000.0f / 60;
+    float degradeRatio = 1.25f;
+
+    // Frames a level is kept before the next is tried, so one slow frame does not skip levels
+    int settleFrameCount = 3;
+
+    // Frames between restore steps once the camera rests
+    int restoreFrameCount = 4;
+
+    // Grid cells along each axis of the bounds for the coarse representation
+    int coarseResolution = 48;
+};
+
+enum MotionDetailLevel
+{
+    motionDetailFull,
+    motionDetailNoNormals,
+    motionDetailCoarse,
+};
+
+// Lowers rendering detail while the camera moves and the frame time misses its target, and restores
+// it a level at a time once the camera rests
+class MotionDetail
+{
+public:
+    MotionDetailSettings settings;
+
+    MotionDetail();
+
+    // Picks the level for the coming frame. Levels that would change nothing, hiding normals that are not
+    // shown or switching to a coarse representation that does not exist, are skipped
+    MotionDetailLevel Update(bool isCameraMoving, float frameMs, bool isNormalRendering, bool hasCoarseRepresentation);
+
+    MotionDetailLevel GetLevel() const { return level; }
+
+private:
+    MotionDetailLevel level;
+    float smoothedFrameMs;
+    int framesAtLevel;
+};
+
+// Clusters vertices on a resolution^3 grid over the bounds and keeps one original vertex per cell, so the
+// coarse triangles index the mesh's own vertex buffer. Triangles collapsing into a cell edge or point are dropped
+std::vector<uint32_t> BuildCoarseIndices(const VertexArray& vertices, const IndexArray& indices, const Bounds& bounds, int resolution);
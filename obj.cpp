@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "block_reader.h"
+#include "obj.h"
+
+constexpr int noNormal = INT_MIN;
+
+struct ObjChunk
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+
+    // Position and normal index per triangle corner, normal is noNormal when the corner has none
+    std::vector<int> corners;
+    std::vector<int> cornerNormals;
+
+    // Corners written with negative indices, resolved relative to the start of the chunk
+    std::vector<size_t> relativeCorners;
+    std::vector<size_t> relativeCornerNormals;
+
+    bool hasAllNormals = true;
+    bool isValid = true;
+};
+
+static const char* SkipSpaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+static bool ParseVec3(const char* p, const char* end, glm::vec3& v)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        p = SkipSpaces(p, end);
+        auto [next, error] = std::from_chars(p, end, v[i]);
+        if (error != std::errc())
+            return false;
+        p = next;
+    }
+
+    return true;
+}
+
+// Parses one v/vt/vn face element, vt is skipped and a missing vn is returned as 0
+static bool ParseFaceElement(const char*& p, const char* end, int& position, int& normal)
+{
+    auto [next, error] = std::from_chars(p, end, position);
+    if (error != std::errc() || position == 0)
+        return false;
+    p = next;
+
+    normal = 0;
+    if (p < end && *p == '/')
+    {
+        p++;
+        if (p < end && *p != '/')
+        {
+            int texture;
+            auto [afterTexture, textureError] = std::from_chars(p, end, texture);
+            if (textureError == std::errc())
+                p = afterTexture;
+        }
+
+        if (p < end && *p == '/')
+        {
+            p++;
+            auto [afterNormal, normalError] = std::from_chars(p, end, normal);
+            if (normalError != std::errc())
+                return false;
+            p = afterNormal;
+        }
+    }
+
+    return true;
+}
+
+static void ParseFace(const char* p, const char* end, ObjChunk& chunk)
+{
+    // Face corners resolved to chunk indices, with a flag for the ones relative to the chunk start
+    int facePositions[3];
+    int faceNormals[3];
+    bool isRelativePosition[3];
+    bool isRelativeNormal[3];
+    int cornerCount = 0;
+
+    while (true)
+    {
+        p = SkipSpaces(p, end);
+        if (p >= end || *p == '\r' || *p == '#')
+            break;
+
+        int position;
+        int normal;
+        if (!ParseFaceElement(p, end, position, normal))
+        {
+            chunk.isValid = false;
+            return;
+        }
+
+        bool isRelative = position < 0;
+        position = isRelative ? int(chunk.positions.size()) + position : position - 1;
+        bool isNormalRelative = normal < 0;
+        normal = normal == 0 ? noNormal : (isNormalRelative ? int(chunk.normals.size()) + normal : normal - 1);
+
+        // Fan triangulation, the first corner stays and the last two slide along the polygon
+        int slot = cornerCount < 3 ? cornerCount : 2;
+        if (cornerCount >= 3)
+        {
+            facePositions[1] = facePositions[2];
+            faceNormals[1] = faceNormals[2];
+            isRelativePosition[1] = isRelativePosition[2];
+            isRelativeNormal[1] = isRelativeNormal[2];
+        }
+
+        facePositions[slot] = position;
+        faceNormals[slot] = normal;
+        isRelativePosition[slot] = isRelative;
+        isRelativeNormal[slot] = isNormalRelative;
+        cornerCount++;
+
+        if (cornerCount < 3)
+            continue;
+
+        for (int i = 0; i < 3; i++)
+        {
+            if (isRelativePosition[i])
+                chunk.relativeCorners.push_back(chunk.corners.size());
+            if (isRelativeNormal[i])
+                chunk.relativeCornerNormals.push_back(chunk.corners.size());
+            if (faceNormals[i] == noNormal)
+                chunk.hasAllNormals = false;
+
+            chunk.corners.push_back(facePositions[i]);
+            chunk.cornerNormals.push_back(faceNormals[i]);
+        }
+    }
+
+    if (cornerCount < 3)
+        chunk.isValid = false;
+}
+
+static void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
+{
+    while (p < end && chunk.isValid)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd)
+            lineEnd = end;
+
+        p = SkipSpaces(p, lineEnd);
+        if (lineEnd - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            glm::vec3 position;
+            chunk.isValid = ParseVec3(p + 2, lineEnd, position);
+            chunk.positions.push_back(position);
+        }
+        else if (lineEnd - p > 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            glm::vec3 normal;
+            chunk.isValid = ParseVec3(p + 3, lineEnd, normal);
+            chunk.normals.push_back(normal);
+        }
+        else if (lineEnd - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            ParseFace(p + 2, lineEnd, chunk);
+        }
+
+        p = lineEnd + 1;
+    }
+}
+
+bool ReadObj(const char* path, VertexArray& vertices, IndexArray& indices, bool& hasNormals)
+{
+    BlockReader reader(path);
+    if (!reader.IsValid())
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        return false;
+    }
+
+    size_t fileSize = reader.GetFileSize();
+    if (fileSize == 0)
+    {
+        std::cerr << "Invalid OBJ format" << std::endl;
+        return false;
+    }
+
+    // Split into ranges of at least 1 MB, each starting right after a line break
+    constexpr size_t minChunkSize = 1024 * 1024;
+    size_t threadCount = std::clamp<size_t>(fileSize / minChunkSize, 1, std::max(1u, std::thread::hardware_concurrency()));
+
+    std::unique_ptr<char[]> data(new char[fileSize]);
+    size_t readSize = 0;
+    auto readUntil = [&](size_t target)
+    {
+        while (readSize < target)
+        {
+            size_t readCount = reader.Read(data.get() + readSize, std::min(blockReaderSettings.blockSize, fileSize - readSize));
+            if (readCount == 0)
+                break;
+            readSize += readCount;
+        }
+    };
+
+    // Each range is parsed as soon as its bytes and the line break ending it have been read,
+    // so the first threads parse while the reader still waits for the rest of the file
+    std::vector<ObjChunk> chunks(threadCount);
+    std::vector<std::future<void>> parseFutures;
+    size_t chunkStart = 0;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        size_t chunkEnd = fileSize;
+        if (i + 1 < threadCount)
+        {
+            size_t searchStart = std::max((i + 1) * fileSize / threadCount, chunkStart);
+            readUntil(searchStart + 1);
+            while (searchStart < readSize)
+            {
+                const char* lineEnd = static_cast<const char*>(memchr(data.get() + searchStart, '\n', readSize - searchStart));
+                if (lineEnd)
+                {
+                    chunkEnd = lineEnd - data.get() + 1;
+                    break;
+                }
+
+                searchStart = readSize;
+                readUntil(readSize + 1);
+            }
+        }
+
+        readUntil(chunkEnd);
+        chunkEnd = std::min(chunkEnd, readSize);
+        parseFutures.emplace_back(std::async(std::launch::async, ParseChunk, data.get() + chunkStart, data.get() + chunkEnd, std::ref(chunks[i])));
+        chunkStart = chunkEnd;
+    }
+
+    for (auto& future : parseFutures)
+        future.get();
+
+    if (reader.DidFail())
+    {
+        std::cerr << "Failed to read file" << std::endl;
+        return false;
+    }
+
+    data.reset();
+
+    // Prefix sums give each chunk its place in the merged arrays
+    std::vector<size_t> vertexOffsets(threadCount + 1, 0);
+    std::vector<size_t> normalOffsets(threadCount + 1, 0);
+    std::vector<size_t> cornerOffsets(threadCount + 1, 0);
+    hasNormals = true;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        if (!chunks[i].isValid)
+        {
+            std::cerr << "Invalid OBJ format" << std::endl;
+            return false;
+        }
+
+        vertexOffsets[i + 1] = vertexOffsets[i] + chunks[i].positions.size();
+        normalOffsets[i + 1] = normalOffsets[i] + chunks[i].normals.size();
+        cornerOffsets[i + 1] = cornerOffsets[i] + chunks[i].corners.size();
+        hasNormals = hasNormals && chunks[i].hasAllNormals;
+    }
+
+    hasNormals = hasNormals && normalOffsets[threadCount] > 0 && cornerOffsets[threadCount] > 0;
+
+    vertices.resize(vertexOffsets[threadCount]);
+    indices.resize(cornerOffsets[threadCount]);
+
+    std::vector<std::future<bool>> mergeFutures;
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        mergeFutures.emplace_back(std::async(
+            std::launch::async,
+            [&](size_t chunkIdx)
+            {
+                ObjChunk& chunk = chunks[chunkIdx];
+                for (size_t j = 0; j < chunk.positions.size(); j++)
+                    vertices[vertexOffsets[chunkIdx] + j] = Vertex(chunk.positions[j], glm::vec3(0));
+
+                for (size_t corner : chunk.relativeCorners)
+                    chunk.corners[corner] += vertexOffsets[chunkIdx];
+                for (size_t corner : chunk.relativeCornerNormals)
+                    chunk.cornerNormals[corner] += normalOffsets[chunkIdx];
+
+                bool isValid = true;
+                for (int corner : chunk.corners)
+                    isValid = isValid && corner >= 0 && size_t(corner) < vertices.size();
+
+                std::copy(chunk.corners.begin(), chunk.corners.end(), indices.begin() + cornerOffsets[chunkIdx]);
+                return isValid;
+            },
+            i));
+    }
+
+    bool isValid = true;
+    for (auto& future : mergeFutures)
+        isValid = future.get() && isValid;
+
+    if (!isValid)
+    {
+        std::cerr << "Invalid index format" << std::endl;
+        return false;
+    }
+
+    if (hasNormals)
+    {
+        // Normals are per corner in OBJ, accumulate them onto the shared positions
+        std::vector<glm::vec3> normals;
+        normals.reserve(normalOffsets[threadCount]);
+        for (const ObjChunk& chunk : chunks)
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+        for (size_t i = 0; i < threadCount; i++)
+        {
+            const ObjChunk& chunk = chunks[i];
+            for (size_t j = 0; j < chunk.corners.size(); j++)
+            {
+                int normal = chunk.cornerNormals[j];
+                if (normal < 0 || size_t(normal) >= normals.size())
+                {
+                    std::cerr << "Invalid normal index" << std::endl;
+                    return false;
+                }
+
+                vertices[chunk.corners[j]].normal += normals[normal];
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "mesh.h"
+
+// Parses a Wavefront OBJ file in parallel. The mapped file is split at line boundaries,
+// each thread parses v/vn/f lines of its range and the results are merged with prefix sums.
+// Polygons are triangulated as fans and negative indices are resolved relative to the
+// vertices read so far. Normals referenced by faces are accumulated onto their positions
+bool ReadObj(const char* path, VertexArray& vertices, IndexArray& indices, bool& hasNormals);
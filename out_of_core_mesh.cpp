@@ -0,0 +1,389 @@
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <unistd.h>
+
+#include "out_of_core_mesh.h"
+
+VertexPageCache::VertexPageCache(int fd, uint64_t offset, uint64_t vertexCount, size_t capacityBytes)
+    : fd(fd), offset(offset), vertexCount(vertexCount), lastPageId(UINT64_MAX), lastPage(nullptr)
+{
+    maxPageCount = std::max<size_t>(1, capacityBytes / (pageVertexCount * sizeof(glm::vec3)));
+}
+
+glm::vec3 VertexPageCache::Get(uint64_t index)
+{
+    uint64_t pageId = index / pageVertexCount;
+
+    // Consecutive lookups mostly hit the same page
+    if (pageId != lastPageId)
+    {
+        auto page = pages.find(pageId);
+        if (page == pages.end())
+        {
+            lastPage = &LoadPage(pageId);
+        }
+        else
+        {
+            lru.splice(lru.begin(), lru, page->second.lruEntry);
+            lastPage = &page->second;
+        }
+
+        lastPageId = pageId;
+    }
+
+    return lastPage->positions[index - pageId * pageVertexCount];
+}
+
+VertexPageCache::Page& VertexPageCache::LoadPage(uint64_t pageId)
+{
+    // Evict the least recently used page when full
+    if (pages.size() >= maxPageCount)
+    {
+        pages.erase(lru.back());
+        lru.pop_back();
+    }
+
+    uint64_t first = pageId * pageVertexCount;
+    uint64_t count = std::min(pageVertexCount, vertexCount - first);
+
+    Page& page = pages[pageId];
+    page.positions.resize(count);
+    if (!ReadFully(fd, page.positions.data(), count * sizeof(glm::vec3), offset + first * sizeof(glm::vec3)))
+    {
+        std::cerr << "Failed to read vertex page" << std::endl;
+        exit(1);
+    }
+
+    lru.push_front(pageId);
+    page.lruEntry = lru.begin();
+    return page;
+}
+
+OutOfCoreMesh::OutOfCoreMesh(const char* path, size_t memoryCap)
+    : memoryCap(memoryCap)
+{
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        exit(1);
+    }
+
+    if (!ReadBinaryMeshHeader(fd, header))
+    {
+        std::cerr << "Invalid binary mesh format" << std::endl;
+        exit(1);
+    }
+
+    chunks.resize(header.chunkCount);
+    if (!ReadFully(fd, chunks.data(), chunks.size() * sizeof(BinaryMeshChunk), GetChunkTableOffset()))
+    {
+        std::cerr << "Failed to read chunk table" << std::endl;
+        exit(1);
+    }
+}
+
+OutOfCoreMesh::~OutOfCoreMesh()
+{
+    close(fd);
+}
+
+size_t OutOfCoreMesh::GetVertexCacheCapacity() const
+{
+    // Two index chunks are in flight at a time, half of the rest goes to vertex pages
+    constexpr size_t minCapacity = 4 * 1024 * 1024;
+    size_t chunkBytes = header.chunkTriangleCount * 3 * sizeof(int);
+    return memoryCap > 2 * chunkBytes + 2 * minCapacity ? (memoryCap - 2 * chunkBytes) / 2 : minCapacity;
+}
+
+void OutOfCoreMesh::StreamChunks(const std::vector<uint64_t>& chunkIds, const std::function<void(const std::vector<int>&)>& process)
+{
+    auto readChunk = [this](uint64_t chunk)
+    {
+        uint64_t first = chunk * header.chunkTriangleCount * 3;
+        uint64_t count = std::min(header.chunkTriangleCount * 3, header.indexCount - first);
+
+        std::vector<int> chunkIndices(count);
+        if (!ReadFully(fd, chunkIndices.data(), count * sizeof(int), GetIndicesOffset(header) + first * sizeof(int)))
+        {
+            std::cerr << "Failed to read index chunk" << std::endl;
+            exit(1);
+        }
+
+        // The header check only covers the counts, indices are checked here before any page is looked up with them
+        for (int index : chunkIndices)
+        {
+            if (index < 0 || uint64_t(index) >= header.vertexCount)
+            {
+                std::cerr << "Invalid binary mesh format" << std::endl;
+                exit(1);
+            }
+        }
+
+        return chunkIndices;
+    };
+
+    if (chunkIds.empty())
+        return;
+
+    // Read the next chunk on another thread while the current one is processed
+    std::future<std::vector<int>> nextChunk = std::async(std::launch::async, readChunk, chunkIds[0]);
+    for (size_t i = 0; i < chunkIds.size(); i++)
+    {
+        std::vector<int> chunkIndices = nextChunk.get();
+        if (i + 1 < chunkIds.size())
+            nextChunk = std::async(std::launch::async, readChunk, chunkIds[i + 1]);
+
+        process(chunkIndices);
+    }
+}
+
+TriangleStatistics OutOfCoreMesh::CalculateStatistics()
+{
+    VertexPageCache cache(fd, GetPositionsOffset(header), header.vertexCount, GetVertexCacheCapacity());
+
+    std::vector<uint64_t> chunkIds(header.chunkCount);
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+        chunkIds[i] = i;
+
+    TriangleStatistics stats;
+    double areaSum = 0;
+    StreamChunks(chunkIds, [&](const std::vector<int>& chunkIndices)
+    {
+        for (size_t i = 0; i + 2 < chunkIndices.size(); i += 3)
+        {
+            const glm::vec3 a = cache.Get(chunkIndices[i]);
+            const glm::vec3 b = cache.Get(chunkIndices[i + 1]);
+            const glm::vec3 c = cache.Get(chunkIndices[i + 2]);
+            const float area = glm::length(glm::cross(b - a, c - a)) * 0.5;
+
+            if (stats.minArea > area && area != 0)
+                stats.minArea = area;
+            if (stats.maxArea < area)
+                stats.maxArea = area;
+            areaSum += area;
+        }
+    });
+
+    uint64_t triangleCount = header.indexCount / 3;
+    stats.avgArea = triangleCount > 0 ? areaSum / triangleCount : 0;
+    return stats;
+}
+
+Bounds OutOfCoreMesh::CalculateBounds()
+{
+    Bounds bounds;
+
+    uint64_t blockVertexCount = std::max<size_t>(1, std::min<size_t>(memoryCap, 16 * 1024 * 1024) / sizeof(glm::vec3));
+    std::vector<glm::vec3> block;
+    for (uint64_t first = 0; first < header.vertexCount; first += blockVertexCount)
+    {
+        block.resize(std::min(blockVertexCount, header.vertexCount - first));
+        if (!ReadFully(fd, block.data(), block.size() * sizeof(glm::vec3), GetPositionsOffset(header) + first * sizeof(glm::vec3)))
+        {
+            std::cerr << "Failed to read vertices" << std::endl;
+            exit(1);
+        }
+
+        for (const glm::vec3& position : block)
+            bounds.Extend(position);
+    }
+
+    return bounds;
+}
+
+bool DoesRayIntersectBox(glm::vec3 rayOrigin, glm::vec3 rayDirection, glm::vec3 min, glm::vec3 max)
+{
+    // Slab test, axes the ray is parallel to only need the origin inside the slab
+    float tMin = 0.0f;
+    float tMax = FLT_MAX;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (rayDirection[axis] == 0.0f)
+        {
+            if (rayOrigin[axis] < min[axis] || rayOrigin[axis] > max[axis])
+                return false;
+            continue;
+        }
+
+        float t1 = (min[axis] - rayOrigin[axis]) / rayDirection[axis];
+        float t2 = (max[axis] - rayOrigin[axis]) / rayDirection[axis];
+        tMin = std::max(tMin, std::min(t1, t2));
+        tMax = std::min(tMax, std::max(t1, t2));
+    }
+
+    return tMin <= tMax;
+}
+
+bool OutOfCoreMesh::IsPointInside(const glm::vec3 p)
+{
+    const glm::vec3 rayOrigin = p;
+    const glm::vec3 rayDirection = glm::vec3(1.0f, 1.0f, 0.0f);
+
+    // Only chunks whose bounds the ray crosses need to be read
+    std::vector<uint64_t> chunkIds;
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+    {
+        if (DoesRayIntersectBox(rayOrigin, rayDirection, chunks[i].min, chunks[i].max))
+            chunkIds.push_back(i);
+    }
+
+    VertexPageCache cache(fd, GetPositionsOffset(header), header.vertexCount, GetVertexCacheCapacity());
+    int intersectionCount = 0;
+    StreamChunks(chunkIds, [&](const std::vector<int>& chunkIndices)
+    {
+        for (size_t i = 0; i + 2 < chunkIndices.size(); i += 3)
+        {
+            const glm::vec3 a = cache.Get(chunkIndices[i]);
+            const glm::vec3 b = cache.Get(chunkIndices[i + 1]);
+            const glm::vec3 c = cache.Get(chunkIndices[i + 2]);
+
+            if (DoesRayIntersectTriangle(rayOrigin, rayDirection, a, b, c))
+                intersectionCount++;
+        }
+    });
+
+    return intersectionCount % 2 == 1;
+}
+
+void OutOfCoreMesh::CalculateNormals(const char* outputPath)
+{
+    int outputFd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outputFd < 0)
+    {
+        std::cerr << "Failed to open file for writing" << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint64_t> chunkIds(header.chunkCount);
+    for (uint64_t i = 0; i < header.chunkCount; i++)
+        chunkIds[i] = i;
+
+    // Vertices are split into ranges whose normals fit in memory. One pass over the triangles writes each corner's
+    // face normal to a temporary file per range, then every range is summed from its file and written out.
+    // Files are opened for up to maxBucketCount ranges at a time, beyond that the triangles are streamed once per group
+    constexpr uint64_t maxBucketCount = 256;
+    constexpr size_t reduceEntryCount = 64 * 1024;
+    size_t cacheCapacity = GetVertexCacheCapacity();
+    uint64_t rangeVertexCount = std::clamp<uint64_t>(cacheCapacity / sizeof(glm::vec3), 1, UINT32_MAX);
+    uint64_t rangeCount = (header.vertexCount + rangeVertexCount - 1) / rangeVertexCount;
+
+    struct CornerNormal
+    {
+        uint32_t vertexOffset;
+        glm::vec3 normal;
+    };
+
+    std::vector<glm::vec3> normals;
+    std::vector<CornerNormal> entries;
+    for (uint64_t firstRange = 0; firstRange < rangeCount; firstRange += maxBucketCount)
+    {
+        uint64_t groupRangeCount = std::min(maxBucketCount, rangeCount - firstRange);
+        uint64_t first = firstRange * rangeVertexCount;
+        uint64_t last = std::min((firstRange + groupRangeCount) * rangeVertexCount, header.vertexCount);
+
+        // A mesh whose normals fit in one range is summed directly without temporary files
+        bool isSingleRange = rangeCount == 1;
+        std::vector<FILE*> buckets;
+        if (isSingleRange)
+        {
+            normals.assign(last - first, glm::vec3(0));
+        }
+        else
+        {
+            // The memory the page cache leaves is shared by the write buffers
+            size_t bufferSize = std::clamp<size_t>(cacheCapacity / groupRangeCount, 4096, 1024 * 1024);
+            for (uint64_t i = 0; i < groupRangeCount; i++)
+            {
+                FILE* bucket = tmpfile();
+                if (!bucket || setvbuf(bucket, nullptr, _IOFBF, bufferSize) != 0)
+                {
+                    std::cerr << "Failed to create a temporary file for normals" << std::endl;
+                    exit(1);
+                }
+
+                buckets.push_back(bucket);
+            }
+        }
+
+        VertexPageCache cache(fd, GetPositionsOffset(header), header.vertexCount, cacheCapacity);
+        StreamChunks(chunkIds, [&](const std::vector<int>& chunkIndices)
+        {
+            for (size_t i = 0; i + 2 < chunkIndices.size(); i += 3)
+            {
+                const uint64_t corners[3] = { uint64_t(chunkIndices[i]), uint64_t(chunkIndices[i + 1]), uint64_t(chunkIndices[i + 2]) };
+                bool hasCorner = false;
+                for (uint64_t corner : corners)
+                    hasCorner = hasCorner || (corner >= first && corner < last);
+                if (!hasCorner)
+                    continue;
+
+                const glm::vec3 a = cache.Get(corners[0]);
+                const glm::vec3 normal = glm::cross(cache.Get(corners[1]) - a, cache.Get(corners[2]) - a);
+                for (uint64_t corner : corners)
+                {
+                    if (corner < first || corner >= last)
+                        continue;
+
+                    if (isSingleRange)
+                    {
+                        normals[corner - first] += normal;
+                        continue;
+                    }
+
+                    uint64_t range = (corner - first) / rangeVertexCount;
+                    CornerNormal entry = { uint32_t(corner - first - range * rangeVertexCount), normal };
+                    if (fwrite(&entry, sizeof(entry), 1, buckets[range]) != 1)
+                    {
+                        std::cerr << "Failed to write normals" << std::endl;
+                        exit(1);
+                    }
+                }
+            }
+        });
+
+        for (uint64_t range = 0; range < groupRangeCount; range++)
+        {
+            uint64_t rangeFirst = first + range * rangeVertexCount;
+            uint64_t rangeLast = std::min(rangeFirst + rangeVertexCount, last);
+            if (!isSingleRange)
+            {
+                normals.assign(rangeLast - rangeFirst, glm::vec3(0));
+                entries.resize(reduceEntryCount);
+
+                FILE* bucket = buckets[range];
+                if (fflush(bucket) != 0 || fseek(bucket, 0, SEEK_SET) != 0)
+                {
+                    std::cerr << "Failed to read normals" << std::endl;
+                    exit(1);
+                }
+
+                size_t entryCount;
+                while ((entryCount = fread(entries.data(), sizeof(CornerNormal), entries.size(), bucket)) > 0)
+                {
+                    for (size_t i = 0; i < entryCount; i++)
+                        normals[entries[i].vertexOffset] += entries[i].normal;
+                }
+
+                bool didRead = !ferror(bucket);
+                fclose(bucket);
+                if (!didRead)
+                {
+                    std::cerr << "Failed to read normals" << std::endl;
+                    exit(1);
+                }
+            }
+
+            if (pwrite(outputFd, normals.data(), normals.size() * sizeof(glm::vec3), rangeFirst * sizeof(glm::vec3)) < 0)
+            {
+                std::cerr << "Failed to write normals" << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    close(outputFd);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+#include "mesh_binary.h"
+
+// LRU cache of fixed-size pages of vertex positions read from a binary mesh file
+class VertexPageCache
+{
+public:
+    VertexPageCache(int fd, uint64_t offset, uint64_t vertexCount, size_t capacityBytes);
+
+    glm::vec3 Get(uint64_t index);
+
+private:
+    struct Page
+    {
+        std::vector<glm::vec3> positions;
+        std::list<uint64_t>::iterator lruEntry;
+    };
+
+    static constexpr uint64_t pageVertexCount = 16 * 1024;
+
+    int fd;
+    uint64_t offset;
+    uint64_t vertexCount;
+    size_t maxPageCount;
+
+    std::unordered_map<uint64_t, Page> pages;
+    std::list<uint64_t> lru;
+    uint64_t lastPageId;
+    Page* lastPage;
+
+    Page& LoadPage(uint64_t pageId);
+};
+
+// Runs queries over a chunked binary mesh file with bounded memory, streaming
+// index chunks through a prefetch thread and reading positions through a page cache
+class OutOfCoreMesh
+{
+public:
+    BinaryMeshHeader header;
+
+    OutOfCoreMesh(const char* path, size_t memoryCap = 256 * 1024 * 1024);
+    ~OutOfCoreMesh();
+
+    TriangleStatistics CalculateStatistics();
+    Bounds CalculateBounds();
+    bool IsPointInside(glm::vec3 p);
+
+    // Writes one non-normalized vec3 normal per vertex to outputPath
+    void CalculateNormals(const char* outputPath);
+
+private:
+    int fd;
+    size_t memoryCap;
+    std::vector<BinaryMeshChunk> chunks;
+
+    size_t GetVertexCacheCapacity() const;
+    void StreamChunks(const std::vector<uint64_t>& chunkIds, const std::function<void(const std::vector<int>&)>& process);
+};
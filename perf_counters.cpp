@@ -0,0 +1,169 @@
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <iostream>
+
+#include "perf_counters.h"
+
+const char* const perfCounterNames[perfCounterCount] = { "cycles", "instructions", "llcMisses", "dtlbMisses", "branchMisses" };
+
+PerfCounterSettings perfCounterSettings;
+
+PerfCounterValues& PerfCounterValues::operator+=(const PerfCounterValues& other)
+{
+    for (int i = 0; i < perfCounterCount; i++)
+    {
+        values[i] += other.values[i];
+        isAvailable[i] = isAvailable[i] || other.isAvailable[i];
+    }
+
+    return *this;
+}
+
+bool PerfCounterValues::IsAnyAvailable() const
+{
+    for (bool isCounterAvailable : isAvailable)
+    {
+        if (isCounterAvailable)
+            return true;
+    }
+
+    return false;
+}
+
+double PerfCounterValues::GetInstructionsPerCycle() const
+{
+    if (!isAvailable[perfCycles] || !isAvailable[perfInstructions] || values[perfCycles] == 0)
+        return 0;
+
+    return double(values[perfInstructions]) / values[perfCycles];
+}
+
+void PrintPerfCounters(const PerfCounterValues& counters, size_t triangleCount)
+{
+    if (!counters.IsAnyAvailable())
+        return;
+
+    std::cout << "   ";
+    for (int i = 0; i < perfCounterCount; i++)
+    {
+        if (counters.isAvailable[i])
+            std::cout << " " << perfCounterNames[i] << " " << counters.values[i];
+    }
+
+    if (counters.isAvailable[perfCycles] && counters.isAvailable[perfInstructions])
+        std::cout << ", IPC " << counters.GetInstructionsPerCycle();
+    if (counters.isAvailable[perfCacheMisses])
+        std::cout << ", " << counters.values[perfCacheMisses] * 64.0 / triangleCount << " miss bytes per triangle";
+    std::cout << std::endl;
+}
+
+#ifdef __linux__
+
+static int OpenCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+
+    // Threads started while counting, like the parallel parts of loading, are added when they exit
+    attr.inherit = 1;
+
+    // User space only, which is what perf_event_paranoid 2 still allows unprivileged
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+PerfCounters::PerfCounters()
+{
+    for (int& fd : fds)
+        fd = -1;
+
+    if (!perfCounterSettings.isEnabled)
+        return;
+
+    constexpr uint64_t dtlbReadMiss =
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    fds[perfCycles] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    fds[perfInstructions] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[perfCacheMisses] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[perfDtlbMisses] = OpenCounter(PERF_TYPE_HW_CACHE, dtlbReadMiss);
+    fds[perfBranchMisses] = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+            close(fd);
+    }
+}
+
+void PerfCounters::Start()
+{
+    for (int fd : fds)
+    {
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+PerfCounterValues PerfCounters::Stop()
+{
+    PerfCounterValues result;
+    for (int i = 0; i < perfCounterCount; i++)
+    {
+        if (fds[i] >= 0)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (int i = 0; i < perfCounterCount; i++)
+    {
+        // value, time enabled, time running
+        uint64_t data[3];
+        if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+            continue;
+
+        result.values[i] = data[2] < data[1] ? uint64_t(double(data[0]) * data[1] / data[2]) : data[0];
+        result.isAvailable[i] = true;
+    }
+
+    return result;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+    for (int& fd : fds)
+        fd = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+}
+
+void PerfCounters::Start()
+{
+}
+
+PerfCounterValues PerfCounters::Stop()
+{
+    return PerfCounterValues();
+}
+
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum PerfCounter
+{
+    perfCycles,
+    perfInstructions,
+    perfCacheMisses,
+    perfDtlbMisses,
+    perfBranchMisses,
+    perfCounterCount
+};
+
+extern const char* const perfCounterNames[perfCounterCount];
+
+struct PerfCounterSettings
+{
+    // Opening counters costs a few system calls per measurement, so benchmarks only collect them on request
+    bool isEnabled = false;
+};
+
+extern PerfCounterSettings perfCounterSettings;
+
+struct PerfCounterValues
+{
+    uint64_t values[perfCounterCount] = {};
+
+    // Counters the kernel or the container refused are left out instead of reported as zero
+    bool isAvailable[perfCounterCount] = {};
+
+    PerfCounterValues& operator+=(const PerfCounterValues& other);
+    bool IsAnyAvailable() const;
+    double GetInstructionsPerCycle() const;
+};
+
+// Prints the counters that could be opened with IPC and cache miss bytes per triangle, nothing when they are disabled or unavailable
+void PrintPerfCounters(const PerfCounterValues& counters, size_t triangleCount);
+
+// Counts hardware events of the calling thread and the threads it starts between Start and Stop
+// with perf_event_open. Counters are scaled when the kernel multiplexes them. Outside Linux
+// nothing is available
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void Start();
+    PerfCounterValues Stop();
+
+private:
+    int fds[perfCounterCount];
+};
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "rapidjson/filereadstream.h"
+
+#include "block_reader.h"
+#include "pipelined_stream.h"
+
+PipelinedReadStream::PipelinedReadStream(Producer producer, size_t bufferSize, size_t bufferCount)
+    : producer(std::move(producer)), bufferSize(bufferSize), isStopping(false), currentBuffer(-1), currentSize(0), count(0), isEof(false)
+{
+    for (size_t i = 0; i < bufferCount; i++)
+    {
+        buffers.emplace_back(new char[bufferSize]);
+        freeBuffers.push_back(i);
+    }
+
+    producerThread = std::thread(&PipelinedReadStream::RunProducer, this);
+    NextBuffer();
+}
+
+PipelinedReadStream::~PipelinedReadStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isStopping = true;
+    }
+    condition.notify_all();
+    producerThread.join();
+}
+
+void PipelinedReadStream::RunProducer()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return isStopping || !freeBuffers.empty(); });
+            if (isStopping)
+                return;
+
+            index = freeBuffers.front();
+            freeBuffers.pop_front();
+        }
+
+        size_t size = producer(buffers[index].get(), bufferSize);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            filledBuffers.push_back({index, size});
+        }
+        condition.notify_all();
+
+        if (size == 0)
+            return;
+    }
+}
+
+void PipelinedReadStream::NextBuffer()
+{
+    if (isEof)
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (currentBuffer >= 0)
+    {
+        freeBuffers.push_back(currentBuffer);
+        condition.notify_all();
+    }
+
+    count += currentSize;
+    condition.wait(lock, [this] { return !filledBuffers.empty(); });
+
+    FilledBuffer filled = filledBuffers.front();
+    filledBuffers.pop_front();
+
+    currentBuffer = filled.index;
+    currentSize = filled.size;
+    buffer = buffers[filled.index].get();
+    current = buffer;
+
+    // An empty buffer marks the end, terminate like rapidjson::FileReadStream does
+    if (filled.size == 0)
+    {
+        buffer[0] = '\0';
+        last = buffer;
+        isEof = true;
+    }
+    else
+        last = buffer + filled.size - 1;
+}
+
+// Compares the first bytes of the file with a format's magic number
+static bool HasMagic(const char* path, const unsigned char* expected, size_t size)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    unsigned char magic[4] = {};
+    size_t readCount = fread(magic, 1, size, file);
+    fclose(file);
+
+    return readCount == size && memcmp(magic, expected, size) == 0;
+}
+
+bool IsGzipFile(const char* path)
+{
+    const unsigned char magic[] = { 0x1f, 0x8b };
+    return HasMagic(path, magic, sizeof(magic));
+}
+
+bool IsZstdFile(const char* path)
+{
+    const unsigned char magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+    return HasMagic(path, magic, sizeof(magic));
+}
+
+bool ParseFileJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled)
+{
+    if (!blockReaderSettings.isUsedForJson)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file)
+        {
+            std::cerr << "Failed to open file" << std::endl;
+            return false;
+        }
+
+        char buffer[65536];
+        rapidjson::FileReadStream inputStream(file, buffer, sizeof(buffer));
+        doc.ParseStream(inputStream);
+        fclose(file);
+        return true;
+    }
+
+    BlockReader reader(path);
+    if (!reader.IsValid())
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        return false;
+    }
+
+    {
+        PipelinedReadStream inputStream(
+            [&reader, isCancelled](char* buffer, size_t capacity) -> size_t
+            {
+                if (isCancelled && *isCancelled)
+                    return 0;
+
+                return reader.Read(buffer, capacity);
+            },
+            blockReaderSettings.blockSize);
+
+        doc.ParseStream(inputStream);
+    }
+
+    if (reader.DidFail())
+        std::cerr << "Failed to read file" << std::endl;
+
+    return !reader.DidFail();
+}
+
+bool DropFileCache(const char* path)
+{
+#ifdef __APPLE__
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool didDrop = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return didDrop;
+#endif
+}
+
+bool ParseGzipJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled)
+{
+    gzFile file = gzopen(path, "rb");
+    if (!file)
+        return false;
+
+    gzbuffer(file, 256 * 1024);
+
+    bool didFail = false;
+    {
+        PipelinedReadStream inputStream(
+            [file, &didFail, isCancelled](char* buffer, size_t capacity) -> size_t
+            {
+                if (isCancelled && *isCancelled)
+                    return 0;
+
+                int readCount = gzread(file, buffer, capacity);
+                if (readCount < 0)
+                    didFail = true;
+                return readCount > 0 ? size_t(readCount) : 0;
+            });
+
+        doc.ParseStream(inputStream);
+    }
+
+    gzclose(file);
+
+    if (didFail)
+        std::cerr << "Failed to decompress file" << std::endl;
+
+    return !didFail;
+}
+
+bool ParseZstdJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    if (!context)
+    {
+        std::cerr << "Failed to create zstd decompression context" << std::endl;
+        fclose(file);
+        return false;
+    }
+
+    std::vector<char> compressed(ZSTD_DStreamInSize());
+    ZSTD_inBuffer input = { compressed.data(), 0, 0 };
+
+    // Non-zero while a frame is unfinished, so a truncated file fails instead of parsing what was decoded
+    size_t frameRemaining = 0;
+    bool didFail = false;
+    {
+        PipelinedReadStream inputStream(
+            [file, context, &compressed, &input, &frameRemaining, &didFail, isCancelled](char* buffer, size_t capacity) -> size_t
+            {
+                if (isCancelled && *isCancelled)
+                    return 0;
+
+                ZSTD_outBuffer output = { buffer, capacity, 0 };
+                while (output.pos < output.size)
+                {
+                    if (input.pos == input.size)
+                    {
+                        input.size = fread(compressed.data(), 1, compressed.size(), file);
+                        input.pos = 0;
+                        if (input.size == 0)
+                        {
+                            didFail = ferror(file) || frameRemaining != 0;
+                            break;
+                        }
+                    }
+
+                    frameRemaining = ZSTD_decompressStream(context, &output, &input);
+                    if (ZSTD_isError(frameRemaining))
+                    {
+                        didFail = true;
+                        break;
+                    }
+                }
+
+                return didFail ? 0 : output.pos;
+            });
+
+        doc.ParseStream(inputStream);
+    }
+
+    ZSTD_freeDCtx(context);
+    fclose(file);
+
+    if (didFail)
+        std::cerr << "Failed to decompress file" << std::endl;
+
+    return !didFail;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+// rapidjson input stream fed by a producer thread through a bounded ring of buffers,
+// so reading or decompressing the next block overlaps with parsing the current one
+class PipelinedReadStream
+{
+public:
+    typedef char Ch;
+
+    // Fills the buffer and returns the number of bytes written, 0 at the end of the input
+    using Producer = std::function<size_t(char* buffer, size_t capacity)>;
+
+    PipelinedReadStream(Producer producer, size_t bufferSize = 1024 * 1024, size_t bufferCount = 4);
+    ~PipelinedReadStream();
+
+    Ch Peek() const { return *current; }
+    Ch Take()
+    {
+        Ch c = *current;
+        if (current < last)
+            ++current;
+        else
+            NextBuffer();
+        return c;
+    }
+    size_t Tell() const { return count + static_cast<size_t>(current - buffer); }
+
+    // Not implemented
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    Ch* PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+    size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+private:
+    struct FilledBuffer
+    {
+        size_t index;
+        size_t size;
+    };
+
+    Producer producer;
+    size_t bufferSize;
+    std::vector<std::unique_ptr<char[]>> buffers;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<size_t> freeBuffers;
+    std::deque<FilledBuffer> filledBuffers;
+    bool isStopping;
+    std::thread producerThread;
+
+    int currentBuffer;
+    size_t currentSize;
+    char* buffer;
+    char* current;
+    char* last;
+    size_t count;
+    bool isEof;
+
+    void RunProducer();
+    void NextBuffer();
+};
+
+bool IsGzipFile(const char* path);
+bool IsZstdFile(const char* path);
+
+// Parses the file from a FileReadStream, or with blockReaderSettings.isUsedForJson reads with a BlockReader on the
+// producer thread so the disk queue stays deep while the calling thread parses. Setting isCancelled ends the
+// block reader's input early, which fails the parse, a FileReadStream parse is only dropped once it ends
+bool ParseFileJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled = nullptr);
+
+// Asks the kernel to drop the cached pages of a file, returns false where that is not supported
+bool DropFileCache(const char* path);
+
+// Decompresses on the producer thread while the calling thread parses
+bool ParseGzipJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled = nullptr);
+
+// Same for zstd, which decodes several times faster than gzip at a similar ratio,
+// so on more than one core the parser rather than decompression sets the load time
+bool ParseZstdJson(const char* path, rapidjson::Document& doc, const std::atomic<bool>* isCancelled = nullptr);
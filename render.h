@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+#include "shader.h"
+
+void GenerateBuffers(uint& vao, uint& vbo, uint& ibo);
+void PopulateBuffers(VertexArray& vertices, const IndexArray& indices, uint& vao, uint& vbo, uint& ibo);
+
+// Vertex array drawing an existing vertex buffer through its own index buffer
+void GenerateIndexedVertexArray(uint& vao, uint vbo, uint& ibo);
+
+// Uploads through the array buffer target, which needs no vertex array bound and so also works from the loader context
+void UpdateIndexBuffer(const std::vector<uint32_t>& indices, uint ibo);
+
+// Rewrites vertex data in place, used when only positions/normals changed and the buffer size stays the same
+void UpdateVertexBuffer(VertexArray& vertices, uint vbo);
+
+// Sets the transforms and the light shared by the mesh shaders, uniforms a shader does not use are ignored
+void SetSceneUniforms(Shader& shader, glm::mat4& model, glm::mat4& view, glm::mat4& projection);
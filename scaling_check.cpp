@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+
+#include "mesh.h"
+#include "mesh_partition.h"
+#include "perf_counters.h"
+#include "scaling_check.h"
+
+constexpr size_t minTriangleCount = 16 * 1024;
+constexpr int runCount = 3;
+
+// Allowed excess over the declared exponent, wide enough for cache effects on the largest meshes
+// while still catching an N^1.5 or N^2 regression
+constexpr double exponentTolerance = 0.3;
+
+struct ScalingKernel
+{
+    const char* name;
+    const char* bound;
+    double exponent;
+
+    // N log N kernels are fitted on time / log2(N) against the exponent
+    bool hasLogFactor;
+
+    // Returns the time of one run in milliseconds and its hardware counters, setup work stays outside the measurement
+    std::function<double(const char* path, PerfCounterValues& counters)> run;
+};
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point startTime)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Times the kernel alone, the counters stay unavailable unless --counters is given
+template <typename Function>
+static double MeasureKernel(PerfCounterValues& counters, Function function)
+{
+    PerfCounters perfCounters;
+    perfCounters.Start();
+    auto startTime = std::chrono::steady_clock::now();
+    function();
+    double runMs = MillisecondsSince(startTime);
+    counters = perfCounters.Stop();
+    return runMs;
+}
+
+// Closed torus with about triangleCount triangles, closed so the inside test has something to count
+static bool WriteTorusJson(const char* path, size_t triangleCount)
+{
+    int ringCount = std::max(3, int(std::sqrt(triangleCount / 4.0)));
+    int segmentCount = ringCount * 2;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    char buffer[65536];
+    rapidjson::FileWriteStream outputStream(file, buffer, sizeof(buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(outputStream);
+    writer.SetMaxDecimalPlaces(6);
+
+    writer.StartObject();
+    writer.Key("geometry_object");
+    writer.StartObject();
+    writer.Key("vertices");
+    writer.StartArray();
+    for (int segment = 0; segment < segmentCount; segment++)
+    {
+        float u = 2 * float(M_PI) * segment / segmentCount;
+        for (int ring = 0; ring < ringCount; ring++)
+        {
+            float v = 2 * float(M_PI) * ring / ringCount;
+            writer.Double((1 + 0.3f * std::cos(v)) * std::cos(u));
+            writer.Double((1 + 0.3f * std::cos(v)) * std::sin(u));
+            writer.Double(0.3f * std::sin(v));
+        }
+    }
+    writer.EndArray();
+
+    writer.Key("triangles");
+    writer.StartArray();
+    for (int segment = 0; segment < segmentCount; segment++)
+    {
+        for (int ring = 0; ring < ringCount; ring++)
+        {
+            int a = segment * ringCount + ring;
+            int b = ((segment + 1) % segmentCount) * ringCount + ring;
+            int c = ((segment + 1) % segmentCount) * ringCount + (ring + 1) % ringCount;
+            int d = segment * ringCount + (ring + 1) % ringCount;
+            for (int idx : { a, b, c, a, c, d })
+                writer.Int(idx);
+        }
+    }
+    writer.EndArray();
+    writer.EndObject();
+    writer.EndObject();
+
+    outputStream.Flush();
+    fclose(file);
+    return true;
+}
+
+// Median of the slopes between every pair of points, a single outlier cannot move it far
+static double FitExponent(const std::vector<double>& sizes, const std::vector<double>& times)
+{
+    std::vector<double> slopes;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        for (size_t j = i + 1; j < sizes.size(); j++)
+            slopes.push_back((std::log(times[j]) - std::log(times[i])) / (std::log(sizes[j]) - std::log(sizes[i])));
+    }
+
+    std::nth_element(slopes.begin(), slopes.begin() + slopes.size() / 2, slopes.end());
+    return slopes[slopes.size() / 2];
+}
+
+int RunScalingCheck(size_t maxTriangleCount)
+{
+    const std::vector<ScalingKernel> kernels = {
+        { "Load (parse, normals, stats)", "N", 1, false,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                // Freed after the measurement like the kernels below
+                std::unique_ptr<Mesh> mesh;
+                return MeasureKernel(counters, [&]() { mesh = std::make_unique<Mesh>(path); });
+            } },
+        { "RecalculateNormals", "N", 1, false,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                Mesh mesh(path);
+                return MeasureKernel(counters, [&]() { mesh.RecalculateNormals(); });
+            } },
+        { "Subdivide", "N", 1, false,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                Mesh mesh(path);
+                return MeasureKernel(counters, [&]() { mesh.Subdivide(); });
+            } },
+        { "IsPointInside", "N", 1, false,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                Mesh mesh(path);
+                return MeasureKernel(counters, [&]() { mesh.IsPointInside(glm::vec3(1, 0, 0)); });
+            } },
+        { "EstimateStatistics", "1", 0, false,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                Mesh mesh(path);
+                return MeasureKernel(counters, [&]() { mesh.EstimateStatistics(); });
+            } },
+        { "PartitionMesh", "N log N", 1, true,
+            [](const char* path, PerfCounterValues& counters)
+            {
+                Mesh mesh(path);
+                return MeasureKernel(counters, [&]() { PartitionMesh(mesh.vertices, mesh.indices, 8); });
+            } },
+    };
+
+    std::vector<size_t> triangleCounts;
+    std::vector<std::string> paths;
+    for (size_t triangleCount = minTriangleCount; triangleCount <= std::max(maxTriangleCount, minTriangleCount * 4); triangleCount *= 2)
+    {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / ("scaling_" + std::to_string(triangleCount) + ".json");
+        if (!WriteTorusJson(path.c_str(), triangleCount))
+        {
+            std::cerr << "Failed to write " << path.string() << std::endl;
+            return 1;
+        }
+
+        triangleCounts.push_back(triangleCount);
+        paths.push_back(path.string());
+    }
+
+    int failedCount = 0;
+    bool hasCounters = false;
+    for (const ScalingKernel& kernel : kernels)
+    {
+        std::vector<double> sizes;
+        std::vector<double> times;
+
+        // Counters of the fastest run on the largest mesh, where the kernel is furthest out of cache
+        PerfCounterValues bestCounters;
+        printf("%-30s", kernel.name);
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            double bestMs = INFINITY;
+            for (int run = 0; run < runCount; run++)
+            {
+                PerfCounterValues counters;
+                double runMs = kernel.run(paths[i].c_str(), counters);
+                if (runMs < bestMs)
+                {
+                    bestMs = runMs;
+                    bestCounters = counters;
+                }
+            }
+
+            // Timer resolution floor, so an immeasurably fast run does not read as zero time
+            bestMs = std::max(bestMs, 0.001);
+            printf(" %9.3f", bestMs);
+
+            sizes.push_back(double(triangleCounts[i]));
+            times.push_back(kernel.hasLogFactor ? bestMs / std::log2(double(triangleCounts[i])) : bestMs);
+        }
+
+        double exponent = FitExponent(sizes, times);
+        bool didPass = exponent <= kernel.exponent + exponentTolerance;
+        failedCount += didPass ? 0 : 1;
+        printf("  ms, exponent %.2f, bound %s %s\n", exponent, kernel.bound, didPass ? "ok" : "FAILED");
+
+        hasCounters = hasCounters || bestCounters.IsAnyAvailable();
+        PrintPerfCounters(bestCounters, triangleCounts.back());
+    }
+
+    if (perfCounterSettings.isEnabled && !hasCounters)
+        std::cerr << "Hardware counters are not available here (perf_event_paranoid or container limits), only times are reported"
+                  << std::endl;
+
+    for (const std::string& path : paths)
+        std::filesystem::remove(path);
+
+    printf("%zu to %zu triangles, %d of %zu kernels over their bound\n", triangleCounts.front(), triangleCounts.back(), failedCount,
+        kernels.size());
+    return failedCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstddef>
+
+// Runs the mesh kernels on generated tori of geometrically increasing size, fits the growth
+// exponent of their run time and fails when it exceeds the kernel's declared complexity.
+// The fit is a median of pairwise slopes over the fastest of several runs per size, so a
+// single slow run or a cache size step does not decide the result. Returns the exit code
+int RunScalingCheck(size_t maxTriangleCount);
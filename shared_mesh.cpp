@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include "shared_mesh.h"
+
+static size_t AlignTo64(size_t size)
+{
+    return (size + 63) & ~size_t(63);
+}
+
+static size_t GetIndicesOffset()
+{
+    return AlignTo64(sizeof(SharedMeshHeader)) + AlignTo64(sizeof(SharedMeshTopology));
+}
+
+static size_t GetSlotStride(uint64_t maxVertexCount)
+{
+    return AlignTo64(sizeof(SharedMeshSlot)) + AlignTo64(maxVertexCount * sizeof(Vertex));
+}
+
+static size_t GetSlotOffset(const SharedMeshHeader& header, uint32_t slot)
+{
+    return AlignTo64(GetIndicesOffset() + header.maxIndexCount * sizeof(uint32_t)) + slot * GetSlotStride(header.maxVertexCount);
+}
+
+static size_t GetMappedSize(const SharedMeshHeader& header)
+{
+    return GetSlotOffset(header, header.slotCount);
+}
+
+int64_t SharedMeshConsumer::GetTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SharedMeshProducer::SharedMeshProducer(const char* name, size_t maxVertexCount, size_t maxIndexCount, uint32_t slotCount)
+    : name(name), mapped(nullptr), mappedSize(0), header(nullptr), topologyVersion(0)
+{
+    SharedMeshHeader layout = {};
+    layout.slotCount = std::max(2u, slotCount);
+    layout.maxVertexCount = maxVertexCount;
+    layout.maxIndexCount = maxIndexCount;
+    size_t size = GetMappedSize(layout);
+
+    // Start from a fresh object so readers of a previous run never see stale frames
+    shm_unlink(name);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, size) != 0)
+    {
+        std::cerr << "Failed to create shared memory " << name << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << name << std::endl;
+        return;
+    }
+
+    mapped = static_cast<char*>(memory);
+    mappedSize = size;
+    header = new (mapped) SharedMeshHeader();
+    header->version = sharedMeshVersion;
+    header->slotCount = layout.slotCount;
+    header->maxVertexCount = maxVertexCount;
+    header->maxIndexCount = maxIndexCount;
+    header->latestFrame.store(0);
+    new (mapped + AlignTo64(sizeof(SharedMeshHeader))) SharedMeshTopology();
+    for (uint32_t i = 0; i < header->slotCount; i++)
+        new (mapped + GetSlotOffset(*header, i)) SharedMeshSlot();
+
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, "MSHM", 4);
+}
+
+SharedMeshProducer::~SharedMeshProducer()
+{
+    if (!mapped)
+        return;
+
+    munmap(mapped, mappedSize);
+    shm_unlink(name.c_str());
+}
+
+bool SharedMeshProducer::SetTopology(const uint32_t* indices, size_t indexCount)
+{
+    if (!mapped || indexCount > header->maxIndexCount)
+        return false;
+
+    topology.assign(indices, indices + indexCount);
+    topologyVersion++;
+
+    SharedMeshTopology* block = reinterpret_cast<SharedMeshTopology*>(mapped + AlignTo64(sizeof(SharedMeshHeader)));
+    uint64_t sequence = block->sequence.load(std::memory_order_relaxed);
+    block->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    block->version = topologyVersion;
+    block->indexCount = indexCount;
+    memcpy(mapped + GetIndicesOffset(), indices, indexCount * sizeof(uint32_t));
+
+    block->sequence.store(sequence + 2, std::memory_order_release);
+    return true;
+}
+
+bool SharedMeshProducer::PublishFrame(const glm::vec3* positions, size_t vertexCount, const glm::vec3* normals)
+{
+    if (!mapped || vertexCount > header->maxVertexCount)
+        return false;
+
+    uint64_t frame = header->latestFrame.load(std::memory_order_relaxed) + 1;
+    uint32_t slotIdx = (frame - 1) % header->slotCount;
+    char* slotMemory = mapped + GetSlotOffset(*header, slotIdx);
+    SharedMeshSlot* slot = reinterpret_cast<SharedMeshSlot*>(slotMemory);
+    Vertex* vertices = reinterpret_cast<Vertex*>(slotMemory + AlignTo64(sizeof(SharedMeshSlot)));
+
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Fields are set directly so producers only need this file and the headers
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        vertices[i].position = positions[i];
+        vertices[i].normal = normals ? normals[i] : glm::vec3(0);
+    }
+
+    if (!normals)
+    {
+        // Smooth non-normalized normals, same as Mesh::CalculateNormals
+        for (size_t i = 0; i + 2 < topology.size(); i += 3)
+        {
+            uint32_t a = topology[i], b = topology[i + 1], c = topology[i + 2];
+            if (a >= vertexCount || b >= vertexCount || c >= vertexCount)
+                continue;
+
+            glm::vec3 normal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+            vertices[a].normal += normal;
+            vertices[b].normal += normal;
+            vertices[c].normal += normal;
+        }
+    }
+
+    slot->frame = frame;
+    slot->vertexCount = vertexCount;
+    slot->topologyVersion = topologyVersion;
+    slot->publishTimeNs = SharedMeshConsumer::GetTimeNs();
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+
+    header->latestFrame.store(frame, std::memory_order_release);
+    return true;
+}
+
+SharedMeshConsumer::SharedMeshConsumer(const char* name)
+    : mapped(nullptr), mappedSize(0), header(nullptr), maxVertexCount(0), maxIndexCount(0), lastFrame(0), lastTopologyVersion(0)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open shared memory " << name << std::endl;
+        return;
+    }
+
+    SharedMeshHeader layout;
+    bool isValid = pread(fd, &layout, sizeof(layout), 0) == sizeof(layout) && memcmp(layout.magic, "MSHM", 4) == 0
+                   && layout.version == sharedMeshVersion;
+    if (!isValid)
+    {
+        std::cerr << "Invalid shared mesh " << name << std::endl;
+        close(fd);
+        return;
+    }
+
+    size_t size = GetMappedSize(layout);
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << name << std::endl;
+        return;
+    }
+
+    mapped = static_cast<const char*>(memory);
+    mappedSize = size;
+    header = reinterpret_cast<const SharedMeshHeader*>(mapped);
+    maxVertexCount = layout.maxVertexCount;
+    maxIndexCount = layout.maxIndexCount;
+}
+
+SharedMeshConsumer::~SharedMeshConsumer()
+{
+    if (mapped)
+        munmap(const_cast<char*>(mapped), mappedSize);
+}
+
+uint64_t SharedMeshConsumer::GetLatestFrame() const
+{
+    return mapped ? header->latestFrame.load(std::memory_order_acquire) : 0;
+}
+
+bool SharedMeshConsumer::AcquireLatest(SharedMeshFrame& frame)
+{
+    uint64_t latest = GetLatestFrame();
+    if (latest == 0 || latest == lastFrame)
+        return false;
+
+    uint32_t slotIdx = (latest - 1) % header->slotCount;
+    const char* slotMemory = mapped + GetSlotOffset(*header, slotIdx);
+    const SharedMeshSlot* slot = reinterpret_cast<const SharedMeshSlot*>(slotMemory);
+
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) || slot->frame != latest || slot->vertexCount > maxVertexCount)
+        return false;
+
+    frame = SharedMeshFrame();
+    frame.frame = latest;
+    frame.slot = slotIdx;
+    frame.slotSequence = sequence;
+    frame.vertices = reinterpret_cast<const Vertex*>(slotMemory + AlignTo64(sizeof(SharedMeshSlot)));
+    frame.vertexCount = slot->vertexCount;
+    frame.publishTimeNs = slot->publishTimeNs;
+    frame.topologyVersion = slot->topologyVersion;
+
+    if (frame.topologyVersion != lastTopologyVersion)
+    {
+        // The frame needs the topology it was built with, wait for a frame that matches otherwise
+        const SharedMeshTopology* block = reinterpret_cast<const SharedMeshTopology*>(mapped + AlignTo64(sizeof(SharedMeshHeader)));
+        uint64_t topologySequence = block->sequence.load(std::memory_order_acquire);
+        if ((topologySequence & 1) || block->version != frame.topologyVersion || block->indexCount > maxIndexCount)
+            return false;
+
+        frame.topologySequence = topologySequence;
+        frame.indices = reinterpret_cast<const uint32_t*>(mapped + GetIndicesOffset());
+        frame.indexCount = block->indexCount;
+    }
+
+    return true;
+}
+
+bool SharedMeshConsumer::IsFrameIntact(const SharedMeshFrame& frame)
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    const SharedMeshSlot* slot = reinterpret_cast<const SharedMeshSlot*>(mapped + GetSlotOffset(*header, frame.slot));
+    if (slot->sequence.load(std::memory_order_relaxed) != frame.slotSequence)
+        return false;
+
+    if (frame.indices)
+    {
+        const SharedMeshTopology* block = reinterpret_cast<const SharedMeshTopology*>(mapped + AlignTo64(sizeof(SharedMeshHeader)));
+        if (block->sequence.load(std::memory_order_relaxed) != frame.topologySequence)
+            return false;
+
+        lastTopologyVersion = frame.topologyVersion;
+    }
+
+    lastFrame = frame.frame;
+    return true;
+}
+
+// Grid of gridSize^2 vertices with a travelling wave as the simulated deformation
+static void GenerateWaveFrame(std::vector<glm::vec3>& positions, int gridSize, float time)
+{
+    for (int y = 0; y < gridSize; y++)
+    {
+        for (int x = 0; x < gridSize; x++)
+        {
+            float u = float(x) / (gridSize - 1) - 0.5f, v = float(y) / (gridSize - 1) - 0.5f;
+            positions[y * gridSize + x] = glm::vec3(u, v, 0.05f * std::sin(20.0f * u + time));
+        }
+    }
+}
+
+int RunSharedMeshBenchmark(size_t vertexCount, int frameCount)
+{
+    const char* name = "/mesh_viewer_benchmark";
+    int gridSize = std::max(2, int(std::sqrt(double(vertexCount))));
+    vertexCount = size_t(gridSize) * gridSize;
+
+    std::vector<uint32_t> indices;
+    for (int y = 0; y + 1 < gridSize; y++)
+    {
+        for (int x = 0; x + 1 < gridSize; x++)
+        {
+            uint32_t i = y * gridSize + x;
+            indices.insert(indices.end(), { i, i + 1, i + gridSize, i + 1, i + gridSize + 1, i + gridSize });
+        }
+    }
+
+    SharedMeshProducer producer(name, vertexCount, indices.size());
+    if (!producer.IsValid())
+        return 1;
+
+    producer.SetTopology(indices.data(), indices.size());
+    std::vector<glm::vec3> positions(vertexCount);
+
+    // Publish cost measured in this process before handing the ring to the child
+    constexpr int warmupFrameCount = 10;
+    double publishMs = 0;
+    for (int i = 0; i < warmupFrameCount; i++)
+    {
+        GenerateWaveFrame(positions, gridSize, i * 0.1f);
+        auto startTime = std::chrono::steady_clock::now();
+        producer.PublishFrame(positions.data(), vertexCount);
+        publishMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count() / warmupFrameCount;
+    }
+
+    SharedMeshConsumer consumer(name);
+    SharedMeshFrame frame;
+    if (consumer.AcquireLatest(frame))
+        consumer.IsFrameIntact(frame);
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        std::cerr << "Failed to start the producer process" << std::endl;
+        return 1;
+    }
+
+    if (pid == 0)
+    {
+        // Simulation at roughly 500 frames per second with positions generated up front
+        GenerateWaveFrame(positions, gridSize, 0);
+        for (int i = 0; i < frameCount; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(2000));
+            producer.PublishFrame(positions.data(), vertexCount);
+        }
+        _exit(0);
+    }
+
+    uint64_t lastFrame = warmupFrameCount + frameCount;
+    std::vector<double> latencies;
+    int tornCount = 0;
+    bool hasProducerExited = false;
+    int producerStatus = 0;
+    while (consumer.GetLatestFrame() < lastFrame || latencies.empty())
+    {
+        if (!consumer.AcquireLatest(frame))
+        {
+            // Frames still published before the producer exited were read on the way here
+            if (hasProducerExited)
+                break;
+
+            hasProducerExited = waitpid(pid, &producerStatus, WNOHANG) == pid;
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Touch the data the way an upload would before checking it was not overwritten
+        volatile float sum = 0;
+        for (size_t i = 0; i < frame.vertexCount; i += 64)
+            sum = sum + frame.vertices[i].position.z;
+
+        if (consumer.IsFrameIntact(frame))
+            latencies.push_back((SharedMeshConsumer::GetTimeNs() - frame.publishTimeNs) / 1000.0);
+        else
+            tornCount++;
+    }
+
+    if (!hasProducerExited)
+        waitpid(pid, &producerStatus, 0);
+
+    if (!WIFEXITED(producerStatus) || WEXITSTATUS(producerStatus) != 0 || latencies.empty())
+    {
+        std::cerr << "The producer process stopped before publishing every frame" << std::endl;
+        return 1;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double meanLatency = 0;
+    for (double latency : latencies)
+        meanLatency += latency / latencies.size();
+
+    std::cout << vertexCount << " vertices, " << frameCount << " frames, " << latencies.size() << " received, " << tornCount << " torn\n"
+              << "Publish: " << publishMs << " ms per frame\n"
+              << "Latency: mean " << meanLatency << " us, p50 " << latencies[latencies.size() / 2] << " us, p99 "
+              << latencies[latencies.size() * 99 / 100] << " us" << std::endl;
+    return 0;
+}
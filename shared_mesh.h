@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+
+// Shared memory layout:
+// header | topology block: header + indices | ring of frame slots: header + vertices (Vertex)
+// Slots and the topology block are guarded by sequence numbers that are odd while being written,
+// so readers can use the mapped data directly and detect frames overwritten while reading
+constexpr uint32_t sharedMeshVersion = 1;
+
+struct SharedMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t slotCount;
+    uint64_t maxVertexCount;
+    uint64_t maxIndexCount;
+
+    // Number of the newest complete frame, 0 before the first one
+    std::atomic<uint64_t> latestFrame;
+};
+
+struct SharedMeshTopology
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t version;
+    uint64_t indexCount;
+};
+
+struct SharedMeshSlot
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t frame;
+    uint64_t vertexCount;
+    uint64_t topologyVersion;
+
+    // steady_clock time at publish, used to measure latency on the reading side
+    int64_t publishTimeNs;
+};
+
+// Writer side, meant to be linked into the simulation
+class SharedMeshProducer
+{
+public:
+    SharedMeshProducer(const char* name, size_t maxVertexCount, size_t maxIndexCount, uint32_t slotCount = 3);
+    ~SharedMeshProducer();
+
+    bool IsValid() const { return mapped != nullptr; }
+
+    // Replaces the triangle list used by the following frames
+    bool SetTopology(const uint32_t* indices, size_t indexCount);
+
+    // Writes the frame into the next slot. Without normals they are calculated from the current topology
+    bool PublishFrame(const glm::vec3* positions, size_t vertexCount, const glm::vec3* normals = nullptr);
+
+private:
+    std::string name;
+    char* mapped;
+    size_t mappedSize;
+    SharedMeshHeader* header;
+    std::vector<uint32_t> topology;
+    uint64_t topologyVersion;
+};
+
+struct SharedMeshFrame
+{
+    uint64_t frame = 0;
+    const Vertex* vertices = nullptr;
+    size_t vertexCount = 0;
+    int64_t publishTimeNs = 0;
+
+    // Only set when the topology changed since the last intact frame
+    const uint32_t* indices = nullptr;
+    size_t indexCount = 0;
+
+    uint64_t slotSequence = 0;
+    uint64_t topologySequence = 0;
+    uint64_t topologyVersion = 0;
+    uint32_t slot = 0;
+};
+
+// Reader side, maps the ring read-only and hands out pointers into it without copying
+class SharedMeshConsumer
+{
+public:
+    SharedMeshConsumer(const char* name);
+    ~SharedMeshConsumer();
+
+    bool IsValid() const { return mapped != nullptr; }
+
+    // Points the frame at the newest slot, returns false when there is nothing newer
+    bool AcquireLatest(SharedMeshFrame& frame);
+
+    // Checks that the producer did not overwrite the frame while it was being read,
+    // only intact frames count as consumed
+    bool IsFrameIntact(const SharedMeshFrame& frame);
+
+    uint64_t GetLatestFrame() const;
+    static int64_t GetTimeNs();
+
+private:
+    const char* mapped;
+    size_t mappedSize;
+    const SharedMeshHeader* header;
+
+    // Limits read when mapping, the header itself stays writable by the producer
+    uint64_t maxVertexCount;
+    uint64_t maxIndexCount;
+    uint64_t lastFrame;
+    uint64_t lastTopologyVersion;
+};
+
+// Forks a producer process and reports publish to acquire latency and publish cost
+int RunSharedMeshBenchmark(size_t vertexCount, int frameCount);
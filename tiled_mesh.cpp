@@ -0,0 +1,485 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#include "metrics.h"
+#include "tiled_mesh.h"
+
+static MetricsGauge queueDepth("viewer_tile_queue_depth", "", "Tile loads waiting for the I/O thread.");
+
+struct TileData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Merges vertices that fall into the same cell of a resolution^3 grid over the tile bounds
+static TileData ClusterVertices(const TileData& tile, glm::vec3 min, glm::vec3 max, int resolution)
+{
+    TileData result;
+    const glm::vec3 extent = glm::max(max - min, glm::vec3(1e-6f));
+
+    std::unordered_map<uint64_t, uint32_t> cellVertexIdxs;
+    std::vector<uint32_t> cellCounts;
+    std::vector<uint32_t> remap(tile.vertices.size());
+
+    for (size_t i = 0; i < tile.vertices.size(); i++)
+    {
+        const glm::ivec3 cell = glm::clamp(glm::ivec3((tile.vertices[i].position - min) / extent * float(resolution)), 0, resolution - 1);
+        const uint64_t key = (uint64_t(cell.x) * resolution + cell.y) * resolution + cell.z;
+
+        auto cellVertex = cellVertexIdxs.find(key);
+        if (cellVertex == cellVertexIdxs.end())
+        {
+            cellVertex = cellVertexIdxs.insert({key, uint32_t(result.vertices.size())}).first;
+            result.vertices.emplace_back(glm::vec3(0), glm::vec3(0));
+            cellCounts.push_back(0);
+        }
+
+        Vertex& clustered = result.vertices[cellVertex->second];
+        clustered.position += tile.vertices[i].position;
+        clustered.normal += tile.vertices[i].normal;
+        cellCounts[cellVertex->second]++;
+        remap[i] = cellVertex->second;
+    }
+
+    for (size_t i = 0; i < result.vertices.size(); i++)
+        result.vertices[i].position /= float(cellCounts[i]);
+
+    // Triangles that collapsed into a cell edge or point are dropped
+    for (size_t i = 0; i < tile.indices.size(); i += 3)
+    {
+        uint32_t a = remap[tile.indices[i]];
+        uint32_t b = remap[tile.indices[i + 1]];
+        uint32_t c = remap[tile.indices[i + 2]];
+        if (a == b || b == c || a == c)
+            continue;
+
+        result.indices.push_back(a);
+        result.indices.push_back(b);
+        result.indices.push_back(c);
+    }
+
+    return result;
+}
+
+bool WriteTiledMesh(Mesh& mesh, const char* path, int gridSize, int lodCount)
+{
+    if (!mesh.EnsureResident())
+        return false;
+
+    lodCount = std::clamp(lodCount, 1, maxTileLods);
+
+    // Assign triangles to tiles by centroid
+    const glm::vec3 extent = glm::max(mesh.bounds.max - mesh.bounds.min, glm::vec3(1e-6f));
+    std::vector<std::vector<int>> tileTriangles(gridSize * gridSize * gridSize);
+    for (size_t i = 0; i < mesh.indices.size(); i += 3)
+    {
+        const Triangle triangle = Triangle::GetTriangle(mesh.vertices, mesh.indices, i);
+        const glm::vec3 centroid = (triangle.vA->position + triangle.vB->position + triangle.vC->position) / 3.0f;
+        const glm::ivec3 cell = glm::clamp(glm::ivec3((centroid - mesh.bounds.min) / extent * float(gridSize)), 0, gridSize - 1);
+        tileTriangles[(cell.x * gridSize + cell.y) * gridSize + cell.z].push_back(i);
+    }
+
+    std::vector<TileInfo> tiles;
+    std::vector<std::vector<TileData>> tileLods;
+    for (const std::vector<int>& triangles : tileTriangles)
+    {
+        if (triangles.empty())
+            continue;
+
+        // Remap to tile local vertices
+        TileInfo info = {};
+        info.min = glm::vec3(FLT_MAX);
+        info.max = glm::vec3(-FLT_MAX);
+
+        TileData lod0;
+        std::unordered_map<int, uint32_t> localIdxs;
+        for (int triangle : triangles)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                const int index = mesh.indices[triangle + corner];
+                auto local = localIdxs.find(index);
+                if (local == localIdxs.end())
+                {
+                    local = localIdxs.insert({index, uint32_t(lod0.vertices.size())}).first;
+                    lod0.vertices.push_back(mesh.vertices[index]);
+                    info.min = glm::min(info.min, mesh.vertices[index].position);
+                    info.max = glm::max(info.max, mesh.vertices[index].position);
+                }
+
+                lod0.indices.push_back(local->second);
+            }
+        }
+
+        std::vector<TileData> lods;
+        lods.push_back(std::move(lod0));
+        for (int lod = 1; lod < lodCount; lod++)
+            lods.push_back(ClusterVertices(lods[0], info.min, info.max, 64 >> lod));
+
+        tiles.push_back(info);
+        tileLods.push_back(std::move(lods));
+    }
+
+    TiledMeshHeader header;
+    memcpy(header.magic, "MTIL", 4);
+    header.version = tiledMeshVersion;
+    header.tileCount = tiles.size();
+    header.lodCount = lodCount;
+
+    // Lay out the data blocks after the tile table
+    uint64_t offset = sizeof(TiledMeshHeader) + tiles.size() * sizeof(TileInfo);
+    for (size_t tile = 0; tile < tiles.size(); tile++)
+    {
+        for (int lod = 0; lod < lodCount; lod++)
+        {
+            TileLod& tileLod = tiles[tile].lods[lod];
+            tileLod.vertexOffset = offset;
+            tileLod.vertexCount = tileLods[tile][lod].vertices.size();
+            offset += tileLod.vertexCount * sizeof(Vertex);
+
+            tileLod.indexOffset = offset;
+            tileLod.indexCount = tileLods[tile][lod].indices.size();
+            offset += tileLod.indexCount * sizeof(uint32_t);
+        }
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        std::cerr << "Failed to open file for writing" << std::endl;
+        return false;
+    }
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(tiles.data(), sizeof(TileInfo), tiles.size(), file);
+    for (const std::vector<TileData>& lods : tileLods)
+    {
+        for (const TileData& data : lods)
+        {
+            fwrite(data.vertices.data(), sizeof(Vertex), data.vertices.size(), file);
+            fwrite(data.indices.data(), sizeof(uint32_t), data.indices.size(), file);
+        }
+    }
+
+    bool didWrite = !ferror(file);
+    fclose(file);
+
+    if (!didWrite)
+        std::cerr << "Failed to write tiled mesh" << std::endl;
+
+    return didWrite;
+}
+
+TileStreamer::TileStreamer(const char* path)
+    : vramUsage(0), residentTileCount(0), visibleTileCount(0), fd(-1), fileSize(0), mapped(nullptr), header(), tiles(nullptr), frame(0),
+      isStopping(false)
+{
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open file" << std::endl;
+        return;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || size_t(fileStat.st_size) < sizeof(TiledMeshHeader))
+    {
+        std::cerr << "Invalid tiled mesh format" << std::endl;
+        return;
+    }
+
+    fileSize = fileStat.st_size;
+    const char* fileMapping = static_cast<const char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
+    if (fileMapping == MAP_FAILED)
+    {
+        std::cerr << "Failed to map tiled mesh" << std::endl;
+        return;
+    }
+
+    memcpy(&header, fileMapping, sizeof(header));
+    const TileInfo* fileTiles = reinterpret_cast<const TileInfo*>(fileMapping + sizeof(TiledMeshHeader));
+    bool isValid = memcmp(header.magic, "MTIL", 4) == 0 && header.version == tiledMeshVersion && header.lodCount >= 1
+        && header.lodCount <= maxTileLods && sizeof(TiledMeshHeader) + size_t(header.tileCount) * sizeof(TileInfo) <= fileSize;
+
+    // Every LOD the streamer can request has to lie inside the mapping, counts are bounded first so the ends cannot overflow
+    auto isRangeInFile = [this](uint64_t offset, uint64_t count, size_t elementSize)
+    { return offset <= fileSize && count <= (fileSize - offset) / elementSize; };
+    for (uint32_t i = 0; isValid && i < header.tileCount; i++)
+    {
+        for (uint32_t lod = 0; isValid && lod < header.lodCount; lod++)
+        {
+            const TileLod& tileLod = fileTiles[i].lods[lod];
+            isValid = isRangeInFile(tileLod.vertexOffset, tileLod.vertexCount, sizeof(Vertex))
+                && isRangeInFile(tileLod.indexOffset, tileLod.indexCount, sizeof(uint32_t));
+        }
+    }
+
+    if (!isValid)
+    {
+        std::cerr << "Invalid tiled mesh format" << std::endl;
+        munmap(const_cast<char*>(fileMapping), fileSize);
+        header = TiledMeshHeader();
+        return;
+    }
+
+    mapped = fileMapping;
+    tiles = fileTiles;
+    states.resize(header.tileCount);
+
+    for (int i = 0; i < 2; i++)
+        ioThreads.emplace_back(&TileStreamer::RunIoThread, this);
+}
+
+TileStreamer::~TileStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        isStopping = true;
+    }
+    queueCondition.notify_all();
+
+    for (std::thread& thread : ioThreads)
+        thread.join();
+
+    for (TileState& state : states)
+        Evict(state);
+
+    if (mapped)
+        munmap(const_cast<char*>(mapped), fileSize);
+    if (fd >= 0)
+        close(fd);
+}
+
+void TileStreamer::RunIoThread()
+{
+    while (true)
+    {
+        LoadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [this] { return isStopping || !requests.empty(); });
+            if (isStopping)
+                return;
+
+            request = requests.front();
+            requests.pop_front();
+            queueDepth.Set(requests.size());
+        }
+
+        // Copying out of the mapping faults the pages in here instead of on the render thread
+        const TileLod& tileLod = tiles[request.tile].lods[request.lod];
+        LoadedTile loaded;
+        loaded.tile = request.tile;
+        loaded.lod = request.lod;
+        loaded.vertexData.assign(mapped + tileLod.vertexOffset, mapped + tileLod.vertexOffset + tileLod.vertexCount * sizeof(Vertex));
+        loaded.indexData.assign(mapped + tileLod.indexOffset, mapped + tileLod.indexOffset + tileLod.indexCount * sizeof(uint32_t));
+
+        // Indices past the tile's vertices would make the GPU read outside the buffer, such a tile is never uploaded
+        const uint32_t* tileIndices = reinterpret_cast<const uint32_t*>(loaded.indexData.data());
+        if (std::any_of(tileIndices, tileIndices + tileLod.indexCount, [&](uint32_t idx) { return idx >= tileLod.vertexCount; }))
+        {
+            std::cerr << "Skipping tile " << request.tile << " with invalid indices" << std::endl;
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        loadedTiles.push_back(std::move(loaded));
+    }
+}
+
+// Clip space frustum test against the eight corners of the box
+static bool IsBoxVisible(const glm::mat4& mvp, glm::vec3 min, glm::vec3 max)
+{
+    glm::vec4 corners[8];
+    for (int i = 0; i < 8; i++)
+    {
+        const glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+        corners[i] = mvp * glm::vec4(corner, 1.0f);
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        bool isAllBelow = true;
+        bool isAllAbove = true;
+        for (const glm::vec4& corner : corners)
+        {
+            isAllBelow = isAllBelow && corner[axis] < -corner.w;
+            isAllAbove = isAllAbove && corner[axis] > corner.w;
+        }
+
+        if (isAllBelow || isAllAbove)
+            return false;
+    }
+
+    return true;
+}
+
+void TileStreamer::Update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, glm::vec3 cameraPos)
+{
+    frame++;
+    visibleTileCount = 0;
+    const glm::mat4 mvp = projection * view * model;
+
+    // Request the LOD each visible tile needs at its distance from the camera
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+
+        for (uint32_t i = 0; i < header.tileCount; i++)
+        {
+            TileState& state = states[i];
+            state.isVisible = IsBoxVisible(mvp, tiles[i].min, tiles[i].max);
+            if (!state.isVisible)
+            {
+                state.pendingLod = -1;
+                continue;
+            }
+
+            visibleTileCount++;
+            state.lastUsedFrame = frame;
+
+            const glm::vec3 center = glm::vec3(model * glm::vec4((tiles[i].min + tiles[i].max) * 0.5f, 1.0f));
+            const float distance = glm::length(center - cameraPos);
+            const int lod = std::clamp(int(std::log2(std::max(distance / settings.lodDistance, 1.0f))), 0, int(header.lodCount) - 1);
+
+            if (state.residentLod == lod)
+                state.pendingLod = -1;
+            else if (state.pendingLod != lod)
+            {
+                state.pendingLod = lod;
+                requests.push_back({i, lod, distance});
+            }
+        }
+
+        // Drop requests that are no longer wanted, then serve missing tiles first and closer tiles before farther ones
+        requests.erase(
+            std::remove_if(requests.begin(), requests.end(), [this](const LoadRequest& request) { return states[request.tile].pendingLod != request.lod; }),
+            requests.end());
+        std::sort(requests.begin(), requests.end(),
+            [this](const LoadRequest& a, const LoadRequest& b)
+            {
+                bool isMissingA = states[a.tile].residentLod < 0;
+                bool isMissingB = states[b.tile].residentLod < 0;
+                return isMissingA != isMissingB ? isMissingA : a.distance < b.distance;
+            });
+        queueDepth.Set(requests.size());
+    }
+    queueCondition.notify_all();
+
+    // Upload finished loads until the per frame budget is spent
+    size_t uploadedBytes = 0;
+    while (uploadedBytes < settings.uploadBudget)
+    {
+        LoadedTile loaded;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (loadedTiles.empty())
+                break;
+
+            loaded = std::move(loadedTiles.front());
+            loadedTiles.pop_front();
+        }
+
+        // Drop loads that are no longer wanted
+        if (states[loaded.tile].pendingLod != loaded.lod)
+            continue;
+
+        uploadedBytes += loaded.vertexData.size() + loaded.indexData.size();
+        Upload(loaded);
+    }
+
+    // Evict the least recently used tiles that are out of view while over the cap
+    while (vramUsage > settings.vramCap)
+    {
+        TileState* oldest = nullptr;
+        for (TileState& state : states)
+        {
+            if (state.residentLod >= 0 && !state.isVisible && (!oldest || state.lastUsedFrame < oldest->lastUsedFrame))
+                oldest = &state;
+        }
+
+        if (!oldest)
+            break;
+
+        Evict(*oldest);
+    }
+}
+
+void TileStreamer::Upload(LoadedTile& loaded)
+{
+    TileState& state = states[loaded.tile];
+    if (state.residentLod < 0)
+    {
+        glGenVertexArrays(1, &state.vao);
+        glBindVertexArray(state.vao);
+
+        glGenBuffers(1, &state.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, state.vbo);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), nullptr);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+        glEnableVertexAttribArray(1);
+
+        glGenBuffers(1, &state.ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ibo);
+
+        residentTileCount++;
+    }
+    else
+    {
+        glBindVertexArray(state.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, state.vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ibo);
+        vramUsage -= state.bytes;
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, loaded.vertexData.size(), loaded.vertexData.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, loaded.indexData.size(), loaded.indexData.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    state.residentLod = loaded.lod;
+    state.pendingLod = -1;
+    state.indexCount = loaded.indexData.size() / sizeof(uint32_t);
+    state.bytes = loaded.vertexData.size() + loaded.indexData.size();
+    vramUsage += state.bytes;
+}
+
+void TileStreamer::Evict(TileState& state)
+{
+    if (state.residentLod < 0)
+        return;
+
+    glDeleteBuffers(1, &state.vbo);
+    glDeleteBuffers(1, &state.ibo);
+    glDeleteVertexArrays(1, &state.vao);
+
+    vramUsage -= state.bytes;
+    residentTileCount--;
+    state = TileState();
+}
+
+void TileStreamer::Draw()
+{
+    for (const TileState& state : states)
+    {
+        if (state.residentLod < 0 || !state.isVisible)
+            continue;
+
+        glBindVertexArray(state.vao);
+        glDrawElements(GL_TRIANGLES, state.indexCount, GL_UNSIGNED_INT, nullptr);
+    }
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#include <OpenGL/gl3.h>
+#include <OpenGL/gl3ext.h>
+#else
+#include <GL/gl.h>
+#endif
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "mesh.h"
+
+// Tiled mesh layout:
+// header | tile table | per tile and LOD: vertices (Vertex) and indices (uint32, tile local)
+// Everything is stored ready for upload so the file can be mapped and sent to the GPU as is
+constexpr uint32_t tiledMeshVersion = 1;
+constexpr int maxTileLods = 4;
+
+struct TiledMeshHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t tileCount;
+    uint32_t lodCount;
+};
+
+struct TileLod
+{
+    uint64_t vertexOffset;
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+};
+
+struct TileInfo
+{
+    glm::vec3 min;
+    glm::vec3 max;
+    TileLod lods[maxTileLods];
+};
+
+// Splits the mesh into a gridSize^3 grid of tiles by triangle centroid and builds
+// coarser LODs per tile with vertex clustering
+bool WriteTiledMesh(Mesh& mesh, const char* path, int gridSize = 4, int lodCount = 3);
+
+struct TileStreamerSettings
+{
+    size_t vramCap = 256 * 1024 * 1024;
+    size_t uploadBudget = 8 * 1024 * 1024;
+    float lodDistance = 2.0f;
+};
+
+class TileStreamer
+{
+public:
+    TileStreamerSettings settings;
+    size_t vramUsage;
+    int residentTileCount;
+    int visibleTileCount;
+
+    // An unreadable or corrupt file leaves the streamer invalid instead of exiting, since it is opened from the mesh picker
+    TileStreamer(const char* path);
+    ~TileStreamer();
+
+    bool IsValid() const { return mapped != nullptr; }
+
+    // Picks visible tiles and their LODs, queues loads and uploads finished ones within the budget
+    void Update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, glm::vec3 cameraPos);
+    void Draw();
+
+    uint32_t GetTileCount() const { return header.tileCount; }
+
+private:
+    struct TileState
+    {
+        int residentLod = -1;
+        int pendingLod = -1;
+        bool isVisible = false;
+        uint64_t lastUsedFrame = 0;
+        uint vao = 0;
+        uint vbo = 0;
+        uint ibo = 0;
+        size_t indexCount = 0;
+        size_t bytes = 0;
+    };
+
+    struct LoadedTile
+    {
+        uint32_t tile;
+        int lod;
+        std::vector<char> vertexData;
+        std::vector<char> indexData;
+    };
+
+    struct LoadRequest
+    {
+        uint32_t tile;
+        int lod;
+        float distance;
+    };
+
+    int fd;
+    size_t fileSize;
+    const char* mapped;
+    TiledMeshHeader header;
+    const TileInfo* tiles;
+    std::vector<TileState> states;
+    uint64_t frame;
+
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<LoadRequest> requests;
+    std::deque<LoadedTile> loadedTiles;
+    std::vector<std::thread> ioThreads;
+    bool isStopping;
+
+    void RunIoThread();
+    void Upload(LoadedTile& loaded);
+    void Evict(TileState& state);
+};